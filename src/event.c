@@ -21,6 +21,9 @@ static int extcommand; // [lc]
 static char jcmd[100];
 static int jidx;
 static gboolean displaying_textwindow = FALSE;
+static guint drag_frame_id;
+static gint64 drag_last_frame;
+static int drag_to_x, drag_to_y; // where the pending frame moves the image
 
 static void qiv_enable_mouse_events(qiv_image *q)
 {
@@ -61,14 +64,30 @@ static void qiv_drag_image(qiv_image *q, int move_to_x, int move_to_y, const cha
         snprintf(infotext, sizeof infotext, "%s", action_msg);
     else
         snprintf(infotext, sizeof infotext, "%s", stalled_msg);
+    interactive_update(q);
     update_image(q, MOVED);
 }
 
+/* Redraw clock for dragging: present the last recorded position at
+ * most once per FRAME_INTERVAL. */
+static gboolean drag_frame(gpointer data)
+{
+    qiv_image *q = data;
+
+    drag_frame_id = 0;
+    drag_last_frame = g_get_monotonic_time();
+    if (q->drag > 1)
+        qiv_drag_image(q, drag_to_x, drag_to_y, "(Drag)", NULL);
+    return FALSE;
+}
+
 void qiv_display_text_window(qiv_image *q, const char *infotextdisplay, const char *strs[],
                              const char *continue_msg)
 {
-    int temp, text_w = 0, text_h, i, maxlines;
-    int x, y, width, height, text_left;
+    int maxlines;
+    int x, y, ox, oy, width, height, text_left, box_w, box_h;
+    GdkDrawable *target;
+    GdkPixmap *box;
 
     int ascent;
     int descent;
@@ -85,8 +104,7 @@ void qiv_display_text_window(qiv_image *q, const char *infotextdisplay, const ch
     else
     {
         x = y = 0;
-        width = q->win_w;
-        height = q->win_h;
+        image_area(q, &ox, &oy, &width, &height); // only the size is needed
     }
 
     /* Calculate maximum number of lines to display */
@@ -95,41 +113,20 @@ void qiv_display_text_window(qiv_image *q, const char *infotextdisplay, const ch
     else
         maxlines = 60;
 
-    pango_layout_set_text(layout, continue_msg, -1);
-    pango_layout_get_pixel_size(layout, &text_w, NULL);
-    for (i = 0; strs[i] && i < maxlines; i++)
-    {
-        pango_layout_set_text(layout, strs[i], -1);
-        pango_layout_get_pixel_size(layout, &temp, NULL);
-        if (text_w < temp)
-            text_w = temp;
-    }
-
-    text_h = (i + 2) * (ascent + descent);
-
     snprintf(infotext, sizeof infotext, "%s", infotextdisplay);
     update_image(q, MIN_REDRAW);
+    target = overlay_target(q);
+
+    /* laid out and rendered once per text */
+    box = overlay_text_window(q, strs, maxlines, continue_msg, &box_w, &box_h);
 
-    text_left = width / 2 - text_w / 2 - 4;
+    text_left = width / 2 - box_w / 2;
     if (text_left < 2)
         text_left = 2; /* if window/screen is smaller than text */
 
-    gdk_draw_rectangle(q->win, q->bg_gc, y, x + text_left, y + height / 2 - text_h / 2 - 4,
-                       x + text_w + 7, text_h + 7);
-    gdk_draw_rectangle(q->win, q->status_gc, y + 1, x + text_left + 1,
-                       y + height / 2 - text_h / 2 - 3, x + text_w + 6, text_h + 6);
-    for (i = 0; strs[i] && i < maxlines; i++)
-    {
-        pango_layout_set_text(layout, strs[i], -1);
-        gdk_draw_layout(q->win, q->text_gc, x + text_left + 4,
-                        y + height / 2 - text_h / 2 + i * (ascent + descent), layout);
-    }
-
-    /* Display Push Any Key... message */
-    pango_layout_set_text(layout, continue_msg, -1);
-    pango_layout_get_pixel_size(layout, &temp, NULL);
-    gdk_draw_layout(q->win, q->text_gc, x + width / 2 - temp / 2,
-                    y + height / 2 - text_h / 2 - descent + (i + 1) * (ascent + descent), layout);
+    gdk_draw_drawable(target, q->bg_gc, box, 0, 0, x + text_left, y + height / 2 - box_h / 2, -1,
+                      -1);
+    present_overlay(q, x + text_left, y + height / 2 - box_h / 2, box_w, box_h);
     displaying_textwindow = TRUE;
 
     /* print also on console */
@@ -151,16 +148,6 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
     int move_step;
     const char *mess[2] = {jcmd, NULL};
 
-    // get windows position if not in fullscreen mode
-    // (because the user might have moved the window our since last redraw)
-    if (!fullscreen)
-    {
-        gdk_window_get_position(q->win, &q->win_x, &q->win_y);
-        //    g_print("position   : q->win_x = %d, q->win_y = %d, q->win_w = %d, mon = %d, typ =
-        //    %d\n", q->win_x, q->win_y, q->win_w,q->mon_id,ev->type);
-    }
-    q->mon_id = gdk_screen_get_monitor_at_window(screen, q->win);
-
     switch (ev->type)
     {
     case GDK_DELETE:
@@ -172,25 +159,20 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
         {
             if (center)
                 center_image(q);
-        }
-        if (fullscreen)
-        {
             update_image(q, FULL_REDRAW);
         }
         else
         {
-            if (q->exposed)
-                update_image(q, MIN_REDRAW);
-            else
-                update_image(q, FULL_REDRAW);
+            /* nothing changed, repaint from the cached pixmaps */
+            expose_image(q, &ev->expose.area);
         }
         q->exposed = 1;
         break;
 
     case GDK_LEAVE_NOTIFY:
-        if (magnify && !fullscreen)
+        if (magnify)
         {
-            gdk_window_hide(magnify_img.win);
+            hide_magnify(q, &magnify_img);
         }
         gdk_pointer_ungrab(CurrentTime);
         gdk_keyboard_ungrab(CurrentTime);
@@ -206,14 +188,19 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                                  GDK_POINTER_MOTION_MASK,
                              NULL, NULL, CurrentTime);
         }
+        break;
 
     case GDK_CONFIGURE:
-        if (magnify && !fullscreen)
+        /* the user or the WM moved the window, remember where it is now
+         * instead of asking the server on every event */
+        if (!fullscreen)
         {
-            gdk_window_get_root_origin(q->win, &magnify_img.frame_x, &magnify_img.frame_y);
-            // printf("GDK_CONFIGURE get_root_origin  %d %d\n",
-            //        magnify_img.frame_x, magnify_img.frame_y);
+            q->win_x = q->wm_x = ev->configure.x;
+            q->win_y = q->wm_y = ev->configure.y;
         }
+        q->mon_id = gdk_screen_get_monitor_at_point(screen,
+                                                    ev->configure.x + ev->configure.width / 2,
+                                                    ev->configure.y + ev->configure.height / 2);
         break;
 
     case GDK_BUTTON_PRESS:
@@ -245,31 +232,20 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
             if (q->drag > 1 &&
                 (q->win_x != q->drag_win_x + move_x || q->win_y != q->drag_win_y + move_y))
             {
-                GdkEvent *e;
-                qiv_disable_mouse_events(q);
-                qiv_drag_image(q, q->drag_win_x + move_x, q->drag_win_y + move_y, "(Drag)", NULL);
-                /* el cheapo mouse motion compression */
-                while (gdk_events_pending())
+                /* only remember where to go, the redraw clock moves it */
+                drag_to_x = q->drag_win_x + move_x;
+                drag_to_y = q->drag_win_y + move_y;
+                if (!drag_frame_id)
                 {
-                    /* [tw] why check if "e" not NULL? */
-                    if ((e = gdk_event_get()))
-                    {
-                        if (e->type == GDK_BUTTON_RELEASE)
-                        {
-                            gdk_event_put(e);
-                            gdk_event_free(e);
-                            break;
-                        }
-                        gdk_event_free(e);
-                    }
+                    gint64 wait = drag_last_frame + FRAME_INTERVAL * 1000 - g_get_monotonic_time();
+                    drag_frame_id = g_timeout_add(MAX(0, wait / 1000), drag_frame, q);
                 }
-                qiv_enable_mouse_events(q);
             }
         }
         else
         {
             // printf(" motion_notify magnify %d  is_hint %d\n", magnify, ev->motion.is_hint);
-            if (magnify && !fullscreen)
+            if (magnify)
             {
                 gint xcur, ycur;
                 if (ev->motion.is_hint)
@@ -300,6 +276,11 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                 move_x = (int)(ev->button.x_root - q->drag_start_x);
                 move_y = (int)(ev->button.y_root - q->drag_start_y);
                 qiv_disable_mouse_events(q);
+                if (drag_frame_id)
+                {
+                    g_source_remove(drag_frame_id);
+                    drag_frame_id = 0;
+                }
 
                 if (q->drag > 1)
                 {
@@ -365,14 +346,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
         { // [lc]
             /* Hide the text window if it is showing */
             displaying_textwindow = FALSE;
-            if (fullscreen)
-            {
-                update_image(q, FULL_REDRAW);
-            }
-            else
-            {
-                update_image(q, MIN_REDRAW);
-            }
+            update_image(q, MIN_REDRAW);
 
             break;
         }
@@ -414,7 +388,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                     /* Hide the text window if it is showing */
                     displaying_textwindow = FALSE;
                     update_image(q, MIN_REDRAW);
-                    run_command(q, jcmd, image_names[image_idx], &numlines, &lines);
+                    run_command(q, jcmd, image_path(image_idx), &numlines, &lines);
                     if (lines && numlines)
                         qiv_display_text_window(q, "(Command output)", lines, "Push any key...");
                 }
@@ -490,7 +464,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                 gdk_window_withdraw(q->win);
                 fullscreen ^= 1;
                 first = 1;
-                qiv_load_image(q);
+                reshow_image(q);
                 break;
 
                 /* Center mode (on/off) */
@@ -511,7 +485,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
             {
                 char **lines;
                 int i = 0;
-                lines = get_exif_values(image_names[image_idx]);
+                lines = get_exif_values(image_path(image_idx));
                 if (lines)
                 {
                     qiv_display_text_window(q, "(Exif Info)", (const char **)lines,
@@ -566,7 +540,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                     gdk_window_withdraw(q->win);
                     fullscreen = 0;
                     first = 1;
-                    qiv_load_image(q);
+                    reshow_image(q);
                 }
                 xwindow = GDK_WINDOW_XWINDOW(q->win);
                 XIconifyWindow(GDK_DISPLAY(), xwindow, DefaultScreen(GDK_DISPLAY()));
@@ -622,6 +596,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                 if (!fullscreen)
                 {
                     snprintf(infotext, sizeof infotext, "(Previous picture)");
+                    interactive_update(q);
                     next_image(-1);
                     qiv_load_image(q);
                 }
@@ -651,6 +626,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                 if (!fullscreen)
                 {
                     snprintf(infotext, sizeof infotext, "(Next picture)");
+                    interactive_update(q);
                     next_image(1);
                     qiv_load_image(q);
                 }
@@ -746,7 +722,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
             case '+':
             case '=':
             zoom_in:
-                if (magnify && !fullscreen)
+                if (magnify)
                 {
                     gint xcur, ycur;
                     magnify_img.zoom *= 1.1;
@@ -756,6 +732,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                 else
                 {
                     snprintf(infotext, sizeof infotext, "(Zoomed in)");
+                    interactive_update(q);
                     zoom_in(q);
                     update_image(q, ZOOMED);
                 }
@@ -766,7 +743,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
             case GDK_KEY_KP_Subtract:
             case '-':
             zoom_out:
-                if (magnify && !fullscreen)
+                if (magnify)
                 {
                     if (magnify_img.zoom > 2.0)
                     {
@@ -781,6 +758,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                 else
                 {
                     snprintf(infotext, sizeof infotext, "(Zoomed out)");
+                    interactive_update(q);
                     zoom_out(q);
                     update_image(q, ZOOMED);
                 }
@@ -791,7 +769,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
             case GDK_KEY_Return:
             case GDK_KEY_KP_Enter:
                 snprintf(infotext, sizeof infotext, "(Reset size)");
-                reload_image(q);
+                reset_view(q);
                 zoom_factor = fixed_zoom_factor; /* reset zoom */
                 check_size(q, TRUE);
                 update_image(q, REDRAW);
@@ -802,18 +780,11 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
             case ' ':
             next_image:
                 snprintf(infotext, sizeof infotext, "(Next picture)");
+                interactive_update(q);
                 next_image(1);
                 qiv_load_image(q);
-                if (magnify && !fullscreen)
-                {
-                    gdk_window_hide(magnify_img.win); // [lc]
-                    //              gdk_flush();
-                    //              gdk_window_get_root_origin(q->win,
-                    //                                         &magnify_img.frame_x,
-                    //                                         &magnify_img.frame_y);
-                    //              printf(">>> frame %d %d\n", magnify_img.frame_x,
-                    //              magnify_img.frame_y); setup_magnify(q, &magnify_img);
-                }
+                if (magnify)
+                    hide_magnify(q, &magnify_img); // [lc]
                 break;
 
                 /* 5 pictures forward - or loop to the beginning */
@@ -821,9 +792,10 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
             case GDK_KEY_Page_Down:
             case GDK_KEY_KP_Page_Down:
                 snprintf(infotext, sizeof infotext, "(5 pictures forward)");
+                interactive_update(q);
                 next_image(5);
-                if (magnify && !fullscreen)
-                    gdk_window_hide(magnify_img.win); // [lc]
+                if (magnify)
+                    hide_magnify(q, &magnify_img); // [lc]
                 qiv_load_image(q);
                 break;
 
@@ -832,9 +804,10 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
             case GDK_KEY_BackSpace:
             previous_image:
                 snprintf(infotext, sizeof infotext, "(Previous picture)");
+                interactive_update(q);
                 next_image(-1);
-                if (magnify && !fullscreen)
-                    gdk_window_hide(magnify_img.win); // [lc]
+                if (magnify)
+                    hide_magnify(q, &magnify_img); // [lc]
                 qiv_load_image(q);
                 break;
 
@@ -843,9 +816,10 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
             case GDK_KEY_Page_Up:
             case GDK_KEY_KP_Page_Up:
                 snprintf(infotext, sizeof infotext, "(5 pictures backward)");
+                interactive_update(q);
                 next_image(-5);
-                if (magnify && !fullscreen)
-                    gdk_window_hide(magnify_img.win); // [lc]
+                if (magnify)
+                    hide_magnify(q, &magnify_img); // [lc]
                 qiv_load_image(q);
                 break;
 
@@ -960,7 +934,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                 /* Flip horizontal */
 
             case 'h':
-                imlib_image_flip_horizontal();
+                flip_view(q, FALSE);
                 snprintf(infotext, sizeof infotext, "(Flipped horizontally)");
                 update_image(q, REDRAW);
                 break;
@@ -968,7 +942,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                 /* Flip vertical */
 
             case 'v':
-                imlib_image_flip_vertical();
+                flip_view(q, TRUE);
                 snprintf(infotext, sizeof infotext, "(Flipped vertically)");
                 update_image(q, REDRAW);
                 break;
@@ -980,20 +954,14 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                 snprintf(infotext, sizeof infotext,
                          watch_file ? "(File watching: on)" : "(File watching: off)");
                 update_image(q, MIN_REDRAW);
-                if (watch_file)
-                {
-                    // check every 100ms
-                    g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, 100, qiv_watch_file, q, NULL);
-                }
+                watch_current(q);
                 break;
 
                 /* Rotate right */
 
             case 'k':
-                imlib_image_orientate(1);
+                rotate_view(q, 1);
                 snprintf(infotext, sizeof infotext, "(Rotated right)");
-                swap(&q->orig_w, &q->orig_h);
-                swap(&q->win_w, &q->win_h);
                 check_size(q, FALSE);
                 correct_image_position(q);
                 update_image(q, REDRAW);
@@ -1002,10 +970,8 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                 /* Rotate left */
 
             case 'l':
-                imlib_image_orientate(3);
+                rotate_view(q, 3);
                 snprintf(infotext, sizeof infotext, "(Rotated left)");
-                swap(&q->orig_w, &q->orig_h);
-                swap(&q->win_w, &q->win_h);
                 check_size(q, FALSE);
                 correct_image_position(q);
                 update_image(q, REDRAW);
@@ -1059,13 +1025,12 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
 
                 /* Show magnifying window */
             case '<': // [lc]
-                if (!fullscreen)
                 {
                     magnify ^= 1;
                     int xcur, ycur;
                     if (!magnify)
                     {
-                        gdk_window_hide(magnify_img.win);
+                        hide_magnify(q, &magnify_img);
                     }
                     else
                     {
@@ -1090,7 +1055,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
                 if (num_monitors > 1)
                 {
                     q->mon_id = (q->mon_id + 1) % num_monitors;
-                    qiv_load_image(q);
+                    reshow_image(q);
                 }
                 break;
             case ',':
@@ -1169,7 +1134,7 @@ void qiv_handle_event(GdkEvent *ev, gpointer data)
             {
                 int numlines = 0;
                 const char **lines;
-                run_command(q, ev->key.string, image_names[image_idx], &numlines, &lines);
+                run_command(q, ev->key.string, image_path(image_idx), &numlines, &lines);
                 if (lines && numlines)
                     qiv_display_text_window(q, "(Command output)", lines, "Push any key...");
             }
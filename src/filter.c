@@ -0,0 +1,292 @@
+/*
+  Module       : filter.c
+  Purpose      : Drop files that are not images from the list
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+
+#ifdef HAVE_MAGIC
+#include <magic.h>
+#endif
+
+/* A file with a known image extension is kept without looking at it.
+ * For the others the first SNIFF_BYTES are read and matched against the
+ * signatures below, by a pool of threads so that on a network mount the
+ * reads overlap.  Headers that are neither a known image nor a known
+ * other format go to libmagic, one by one, if we have it.  In the end
+ * the list is compacted in one pass, keeping the order.
+ *
+ * Files the --cache index has seen before are not looked at again. */
+
+#define SNIFF_BYTES 512 // bytes read from the start of a file
+#define FILTER_CHUNK 256 // files per thread pool task
+
+enum
+{
+    SNIFF_OTHER, // not an image, drop it
+    SNIFF_IMAGE, // keep it
+    SNIFF_UNKNOWN, // ask libmagic
+    SNIFF_PENDING // the extension didn't tell, read the header
+};
+
+typedef struct _signature
+{
+    int offset, len;
+    const char *bytes;
+    int offset2, len2; // second part, len2 0 if there is none
+    const char *bytes2;
+    int (*check)(const guchar *buf, int len); // closer look, NULL if none
+} signature;
+
+/* Short magics also start ordinary text, "P1 ..." or "BMW ..." */
+static int netpbm_check(const guchar *buf, int len)
+{
+    int i = 2;
+
+    if (len <= i || !g_ascii_isspace(buf[i]))
+        return 0;
+    /* whitespace and comments, then the width */
+    while (i < len && (g_ascii_isspace(buf[i]) || buf[i] == '#'))
+        if (buf[i++] == '#')
+            while (i < len && buf[i] != '\n')
+                i++;
+    return i < len && g_ascii_isdigit(buf[i]);
+}
+
+static int bmp_check(const guchar *buf, int len)
+{
+    guint32 size;
+
+    if (len < 18)
+        return 0;
+    size = buf[14] | buf[15] << 8 | buf[16] << 16 | (guint32)buf[17] << 24;
+    /* the known DIB header sizes */
+    return size == 12 || size == 16 || size == 40 || size == 52 || size == 56 || size == 64 ||
+           size == 108 || size == 124;
+}
+
+static const signature image_signatures[] = {
+    {0, 3, "\xff\xd8\xff"}, // jpeg
+    {0, 2, "\xff\x0a"}, // jpeg xl codestream
+    {0, 12, "\0\0\0\x0cJXL \r\n\x87\n"}, // ... container
+    {0, 6, "GIF87a"},
+    {0, 6, "GIF89a"},
+    {0, 4, "II*\0"}, // tiff
+    {0, 4, "MM\0*"},
+    {0, 4, "II+\0"}, // bigtiff
+    {0, 4, "MM\0+"},
+    {0, 9, "/* XPM */"},
+    {0, 8, "\x89PNG\r\n\x1a\n"},
+    {0, 2, "P1", 0, 0, NULL, netpbm_check},
+    {0, 2, "P2", 0, 0, NULL, netpbm_check},
+    {0, 2, "P3", 0, 0, NULL, netpbm_check},
+    {0, 2, "P4", 0, 0, NULL, netpbm_check},
+    {0, 2, "P5", 0, 0, NULL, netpbm_check},
+    {0, 2, "P6", 0, 0, NULL, netpbm_check},
+    {0, 1, "\x0a", 2, 1, "\x01"}, // pcx, run length encoded
+    {0, 2, "BM", 0, 0, NULL, bmp_check},
+    {0, 4, "\0\0\1\0"}, // ico
+    {0, 4, "\xd7\xcd\xc6\x9a"}, // placeable wmf
+    {0, 4, "RIFF", 8, 4, "WEBP"},
+    {0, 0, NULL}};
+
+/* ISO base media files that may hold a still image, whether we can
+ * show it depends on the loaders; libmagic decides */
+static const signature unknown_signatures[] = {
+    {4, 4, "ftyp", 8, 4, "heic"}, // heif
+    {4, 4, "ftyp", 8, 4, "heix"},
+    {4, 4, "ftyp", 8, 4, "heim"},
+    {4, 4, "ftyp", 8, 4, "heis"},
+    {4, 4, "ftyp", 8, 4, "hevc"},
+    {4, 4, "ftyp", 8, 4, "hevx"},
+    {4, 4, "ftyp", 8, 4, "mif1"},
+    {4, 4, "ftyp", 8, 4, "msf1"},
+    {4, 4, "ftyp", 8, 4, "avif"},
+    {4, 4, "ftyp", 8, 4, "avis"},
+    {0, 0, NULL}};
+
+/* Common neighbours of images that need no closer look */
+static const signature other_signatures[] = {
+    {0, 4, "%PDF"},
+    {0, 4, "PK\3\4"}, // zip
+    {0, 4, "\x7f" "ELF"},
+    {0, 9, "<?xpacket"}, // xmp sidecar
+    {0, 10, "<x:xmpmeta"},
+    {4, 4, "ftyp"}, // mp4, mov and the like
+    {0, 4, "RIFF", 8, 4, "AVI "},
+    {0, 4, "RIFF", 8, 4, "WAVE"},
+    {0, 4, "\x1a\x45\xdf\xa3"}, // matroska, webm
+    {0, 3, "ID3"}, // mp3
+    {0, 4, "OggS"},
+    {0, 4, "fLaC"},
+    {0, 0, NULL}};
+
+static const qiv_path *filter_list;
+static guint8 *filter_state;
+
+int check_extension(const char *name)
+{
+    char *extn = strrchr(name, '.');
+    int i;
+
+    if (extn)
+        for (i = 0; image_extensions[i]; i++)
+            if (strcmp(extn, image_extensions[i]) == 0)
+                return 1;
+
+    return 0;
+}
+
+static int signature_match(const signature *s, const char *buf, int len)
+{
+    if (s->offset + s->len > len || memcmp(buf + s->offset, s->bytes, s->len))
+        return 0;
+    if (s->len2 && (s->offset2 + s->len2 > len || memcmp(buf + s->offset2, s->bytes2, s->len2)))
+        return 0;
+    return !s->check || s->check((const guchar *)buf, len);
+}
+
+/* Classify a file by its first bytes */
+static int sniff(const char *name)
+{
+    char buf[SNIFF_BYTES + 1];
+    const signature *s;
+    int fd, len, i;
+
+    if ((fd = open(name, O_RDONLY | O_CLOEXEC)) < 0)
+        return SNIFF_OTHER;
+    len = read(fd, buf, SNIFF_BYTES);
+    close(fd);
+    if (len <= 0)
+        return SNIFF_OTHER;
+    buf[len] = '\0';
+
+    for (s = image_signatures; s->len; s++)
+        if (signature_match(s, buf, len))
+            return SNIFF_IMAGE;
+    for (s = unknown_signatures; s->len; s++)
+        if (signature_match(s, buf, len))
+            return SNIFF_UNKNOWN;
+    for (s = other_signatures; s->len; s++)
+        if (signature_match(s, buf, len))
+            return SNIFF_OTHER;
+
+    /* text: an svg if it says so early on, otherwise nothing we show */
+    for (i = 0; i < len; i++)
+        if (!buf[i] || ((guchar)buf[i] < 0x20 && !g_ascii_isspace(buf[i])))
+            return SNIFF_UNKNOWN;
+    return strstr(buf, "<svg") ? SNIFF_IMAGE : SNIFF_OTHER;
+}
+
+static void sniff_chunk(gpointer data, gpointer user_data)
+{
+    int start = GPOINTER_TO_INT(data) - 1, end = GPOINTER_TO_INT(user_data), i;
+    char name[PATH_MAX];
+
+    end = MIN(start + FILTER_CHUNK, end);
+    for (i = start; i < end; i++)
+        if (filter_state[i] == SNIFF_PENDING)
+        {
+            path_copy(filter_list[i], name, sizeof name);
+            filter_state[i] = sniff(name);
+        }
+}
+
+#ifdef HAVE_MAGIC
+static int check_magic(magic_t cookie, const char *name)
+{
+    const char *description = NULL;
+    int i;
+    int ret = 0;
+
+    description = magic_file(cookie, name);
+    if (description)
+    {
+        /* libmagic appends details like the size */
+        for (i = 0; image_magic[i]; i++)
+            if (strncmp(description, image_magic[i], strlen(image_magic[i])) == 0)
+            {
+                ret = 1;
+                break;
+            }
+    }
+    return ret;
+}
+#endif
+
+/* Keep the images in list, in their order */
+void filter_images(int *images, qiv_path *list)
+{
+    char name[PATH_MAX];
+    int i, j, pending = 0;
+#ifdef HAVE_MAGIC
+    magic_t cookie = NULL;
+#endif
+
+    filter_state = g_new(guint8, *images);
+    filter_list = list;
+    for (i = 0; i < *images; i++)
+    {
+        switch (index_image(list[i]))
+        {
+        case INDEX_IMAGE:
+            filter_state[i] = SNIFF_IMAGE;
+            break;
+        case INDEX_OTHER:
+            filter_state[i] = SNIFF_OTHER;
+            break;
+        default:
+            if (!path_copy(list[i], name, sizeof name))
+                filter_state[i] = SNIFF_OTHER; // can't be opened by that name either
+            else
+                filter_state[i] = check_extension(name) ? SNIFF_IMAGE : SNIFF_PENDING;
+        }
+        pending += filter_state[i] == SNIFF_PENDING;
+    }
+
+    if (pending)
+    {
+        GThreadPool *pool = g_thread_pool_new(sniff_chunk, GINT_TO_POINTER(*images),
+                                              CLAMP(g_get_num_processors() * 2, 1, FILTER_THREADS),
+                                              TRUE, NULL);
+
+        for (i = 0; i < *images; i += FILTER_CHUNK)
+            g_thread_pool_push(pool, GINT_TO_POINTER(i + 1), NULL);
+        g_thread_pool_free(pool, FALSE, TRUE);
+    }
+
+    for (i = j = 0; i < *images; i++)
+    {
+        if (filter_state[i] == SNIFF_UNKNOWN)
+        {
+#ifdef HAVE_MAGIC
+            if (!cookie)
+            {
+                cookie = magic_open(MAGIC_SYMLINK);
+                magic_load(cookie, NULL);
+            }
+            path_copy(list[i], name, sizeof name);
+            filter_state[i] = check_magic(cookie, name);
+#else
+            filter_state[i] = SNIFF_OTHER;
+#endif
+        }
+        index_set_image(list[i], filter_state[i] == SNIFF_IMAGE ? INDEX_IMAGE : INDEX_OTHER);
+        if (filter_state[i] == SNIFF_IMAGE)
+            list[j++] = list[i];
+    }
+    *images = j;
+
+#ifdef HAVE_MAGIC
+    if (cookie)
+        magic_close(cookie);
+#endif
+    g_free(filter_state);
+}
@@ -9,28 +9,48 @@
 
 #include "qiv.h"
 #include <gdk/gdkx.h>
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 
 static void setup_win(qiv_image *);
-// static void setup_magnify(qiv_image *, qiv_mgl *); // [lc]
+static void magnify_invalidate(qiv_mgl *);
+static void magnify_draw(qiv_image *, qiv_mgl *);
 static int used_masks_before = 0;
 static struct timeval load_before, load_after;
 static double load_elapsed;
 
-Imlib_Image im_from_pixbuf_loader(char *image_name, int *has_alpha)
+/* The image scaled to the current window size, without color
+ * modifications.  Brightness, contrast and gamma changes are applied
+ * to this copy instead of rescaling the full image every time. */
+static Imlib_Image scaled_im = NULL;
+static Imlib_Image adjusted_im = NULL; // scaled_im with the color LUT applied
+static DATA32 *scaled_data; // pixels of scaled_im, owned by us
+static gint scaled_w, scaled_h;
+static double scale_elapsed; // time the background scaling took
+static int scaled_fast; // scaled_im is a nearest neighbour preview
+
+/* While the user zooms, drags or flips through images, frames are
+ * rendered with the fast scaler.  Once the input has been quiet for
+ * REFINE_DELAY ms the preview is replaced by a high quality one. */
+static int fast_render;
+static guint refine_id;
+
+/* Decode image_name into malloc'ed ARGB data of size *w x *h.  Doesn't
+ * touch imlib, so it may run in a thread of its own. */
+DATA32 *argb_from_pixbuf_loader(const char *image_name, int *has_alpha, int *w, int *h)
 {
     GError *error = NULL;
     GdkPixbuf *pixbuf_ori;
     GdkPixbuf *pixbuf;
-    char *argbdata;
+    char *argbdata = NULL;
     guchar *pixels;
     guchar *pixels_ori;
     int i, j, k, rs;
     int pb_w, pb_h;
-    Imlib_Image *im = NULL;
     const gchar *gdk_orientation = NULL;
 #ifdef SUPPORT_LCMS
     char *icc_profile;
@@ -138,7 +158,7 @@ Imlib_Image im_from_pixbuf_loader(char *image_name, int *has_alpha)
         }
 
 #ifdef SUPPORT_LCMS
-        if ((icc_profile = get_icc_profile(image_name)))
+        if ((icc_profile = get_icc_profile((char *)image_name)))
         {
             h_emb_profile = cmsOpenProfileFromMem(icc_profile + sizeof(cmsUInt32Number),
                                                   *(cmsUInt32Number *)icc_profile);
@@ -173,14 +193,29 @@ Imlib_Image im_from_pixbuf_loader(char *image_name, int *has_alpha)
             cmsDoTransform(h_cms_transform, argbdata, argbdata, pb_w * pb_h);
         }
 #endif
-        im = imlib_create_image_using_copied_data(pb_w, pb_h, (DATA32 *)argbdata);
-        free(argbdata);
+        *w = pb_w;
+        *h = pb_h;
         if (*has_alpha)
         {
             g_object_unref(pixbuf);
         }
         g_object_unref(pixbuf_ori);
     }
+    return (DATA32 *)argbdata;
+}
+
+Imlib_Image im_from_pixbuf_loader(const char *image_name, int *has_alpha)
+{
+    Imlib_Image *im = NULL;
+    DATA32 *argbdata;
+    int w, h;
+
+    argbdata = argb_from_pixbuf_loader(image_name, has_alpha, &w, &h);
+    if (argbdata)
+    {
+        im = imlib_create_image_using_copied_data(w, h, argbdata);
+        free(argbdata);
+    }
     return im;
 }
 
@@ -191,18 +226,22 @@ Imlib_Image im_from_pixbuf_loader(char *image_name, int *has_alpha)
 void qiv_load_image(qiv_image *q)
 {
     struct stat statbuf;
-    const char *image_name = image_names[image_idx];
+    char image_name[PATH_MAX];
     Imlib_Image *im = NULL;
-    int has_alpha = 0, rot;
+    int has_alpha = 0;
 
+    /* kept across the loader, don't hold a path_get() buffer */
+    if (!path_copy(image_list[image_idx], image_name, sizeof image_name))
+        g_print("qiv: path too long: %s\n", image_name);
     q->exposed = 0;
     gettimeofday(&load_before, 0);
+    watch_current(q);
 
+    discard_scaled_image();
     if (imlib_context_get_image())
         imlib_free_image();
 
     stat(image_name, &statbuf);
-    current_mtime = statbuf.st_mtime;
     file_size = statbuf.st_size;
 
 #ifdef DEBUG
@@ -213,7 +252,51 @@ void qiv_load_image(qiv_image *q)
     im = imlib_load_image( (char*)image_name );
     */
 
-    im = im_from_pixbuf_loader((char *)image_name, &has_alpha);
+    im = im_from_pixbuf_loader(image_name, &has_alpha);
+    set_loaded_image(q, im, has_alpha);
+
+    if (first)
+    {
+        setup_win(q);
+    }
+
+    check_size(q, TRUE);
+
+    /* desktop-background -> exit */
+    if (to_root || to_root_t || to_root_s)
+    {
+        if (!im)
+        {
+            fprintf(stderr, "qiv: cannot load background_image\n");
+            qiv_exit(1);
+        }
+        set_desktop_image(q);
+        if (root_daemon && (images > 1 || list_building()))
+        {
+            root_daemon_start(q);
+            return;
+        }
+        qiv_exit(0);
+    }
+
+    gdk_window_set_background(q->win, im ? &image_bg : &error_bg);
+
+    gettimeofday(&load_after, 0);
+    load_elapsed = ((load_after.tv_sec + load_after.tv_usec / 1.0e6) -
+                    (load_before.tv_sec + load_before.tv_usec / 1.0e6));
+
+    update_image(q, FULL_REDRAW);
+    //    if (magnify && !fullscreen) {  // [lc]
+    //     setup_magnify(q, &magnify_img);
+    //     update_magnify(q, &magnify_img, FULL_REDRAW, 0, 0);
+    //    }
+}
+
+/* Make the freshly decoded im (NULL on error) the current image and
+ * apply the requested rotation */
+void set_loaded_image(qiv_image *q, Imlib_Image im, int has_alpha)
+{
+    int rot;
 
     if (!im)
     { /* error */
@@ -260,37 +343,76 @@ void qiv_load_image(qiv_image *q)
         if (rot && rot != 2)
             correct_image_position(q);
     }
+    q->view_rot = q->view_flip = 0;
+}
 
+/* Show the image that is already loaded again, in a new window after
+ * toggling fullscreen or on another monitor.  Nothing is read from
+ * disk. */
+void reshow_image(qiv_image *q)
+{
+    q->exposed = 0;
     if (first)
     {
         setup_win(q);
     }
-
     check_size(q, TRUE);
+    gdk_window_set_background(q->win, q->error ? &error_bg : &image_bg);
+    update_image(q, FULL_REDRAW);
+}
 
-    /* desktop-background -> exit */
-    if (to_root || to_root_t || to_root_s)
+/* Rotation and flips are done on the image itself.  q->view_rot and
+ * q->view_flip record what has been done since loading: the image
+ * shown is the loaded one flipped horizontally if view_flip, then
+ * turned view_rot quarters clockwise.  That is enough to undo it. */
+
+/* Turn the image by quarters * 90 degrees clockwise */
+void rotate_view(qiv_image *q, int quarters)
+{
+    quarters &= 3;
+    if (!quarters)
+        return;
+    discard_scaled_image();
+    imlib_image_orientate(quarters);
+    if (quarters != 2)
     {
-        if (!im)
-        {
-            fprintf(stderr, "qiv: cannot load background_image\n");
-            qiv_exit(1);
-        }
-        set_desktop_image(q);
-        qiv_exit(0);
+        swap(&q->orig_w, &q->orig_h);
+        swap(&q->win_w, &q->win_h);
     }
+    q->view_rot = (q->view_rot + quarters) & 3;
+}
 
-    gdk_window_set_background(q->win, im ? &image_bg : &error_bg);
+void flip_view(qiv_image *q, int vertical)
+{
+    discard_scaled_image();
+    if (vertical)
+        imlib_image_flip_vertical();
+    else
+        imlib_image_flip_horizontal();
+    /* H R^r = R^-r H, and V = R^2 H */
+    q->view_rot = ((vertical ? 2 : 0) - q->view_rot) & 3;
+    q->view_flip ^= 1;
+}
 
-    gettimeofday(&load_after, 0);
-    load_elapsed = ((load_after.tv_sec + load_after.tv_usec / 1.0e6) -
-                    (load_before.tv_sec + load_before.tv_usec / 1.0e6));
+/* Back to the image as loaded: no flips or turns, original colors */
+void reset_view(qiv_image *q)
+{
+    if (!q->error)
+    {
+        rotate_view(q, -q->view_rot);
+        if (q->view_flip)
+        {
+            discard_scaled_image();
+            imlib_image_flip_horizontal();
+        }
+    }
+    q->view_rot = q->view_flip = 0;
 
-    update_image(q, FULL_REDRAW);
-    //    if (magnify && !fullscreen) {  // [lc]
-    //     setup_magnify(q, &magnify_img);
-    //     update_magnify(q, &magnify_img, FULL_REDRAW, 0, 0);
-    //    }
+    q->win_w = (gint)(q->orig_w * (1 + zoom_factor * 0.1));
+    q->win_h = (gint)(q->orig_h * (1 + zoom_factor * 0.1));
+    reset_mod(q);
+    if (center)
+        center_image(q);
 }
 
 static void setup_imlib_for_drawable(GdkDrawable *d)
@@ -322,44 +444,286 @@ static void setup_imlib_color_modifier(qiv_color_modifier q)
     imlib_modify_color_modifier_contrast(q.contrast / 256.0);
 }
 
+/* Forget the scaled copy, its size changed */
+static void free_scaled_image(void)
+{
+    Imlib_Image im = imlib_context_get_image();
+
+    /* the scaler may still be reading the image */
+    scale_job_cancel();
+
+    if (scaled_im)
+    {
+        imlib_context_set_image(scaled_im);
+        imlib_free_image();
+        scaled_im = NULL;
+        free(scaled_data);
+        scaled_data = NULL;
+    }
+    if (adjusted_im)
+    {
+        imlib_context_set_image(adjusted_im);
+        imlib_free_image();
+        adjusted_im = NULL;
+    }
+    imlib_context_set_image(im);
+}
+
+/* Forget everything derived from the image, it changed */
+void discard_scaled_image(void)
+{
+    free_scaled_image();
+    xrender_invalidate();
+}
+
+/* Take over the pixels the background scaler produced */
+void install_scaled_image(qiv_image *q, DATA32 *data, gint w, gint h, double elapsed)
+{
+    Imlib_Image im = imlib_context_get_image();
+    int has_alpha = imlib_image_has_alpha();
+
+    free_scaled_image();
+    scaled_data = data;
+    scaled_w = w;
+    scaled_h = h;
+    scaled_im = imlib_create_image_using_data(w, h, data);
+    imlib_context_set_image(scaled_im);
+    imlib_image_set_has_alpha(has_alpha);
+    imlib_context_set_image(im);
+    scale_elapsed = elapsed;
+    scaled_fast = 0;
+}
+
+/* Timeout handler: the user stopped interacting, replace the preview */
+static gboolean render_refine(gpointer data)
+{
+    qiv_image *q = data;
+
+    refine_id = 0;
+    fast_render = 0;
+    tile_cache_set_fast(0);
+
+    if (q->error)
+        return FALSE;
+    if (q->tiled)
+    {
+        if (tile_cache_refine(q))
+            update_image(q, MOVED);
+    }
+    else if (scaled_im && scaled_fast)
+    {
+        scale_job_submit(q, imlib_image_get_data_for_reading_only(), q->orig_w, q->orig_h,
+                         scaled_w, scaled_h, REDRAW);
+    }
+    else if (!scaled_im || scaled_w != q->win_w || scaled_h != q->win_h)
+    {
+        /* rendered straight from the original without anti-aliasing */
+        update_image(q, REDRAW);
+    }
+    return FALSE;
+}
+
+/* The next update is part of an interaction: render it fast and
+ * (re)start the timer for the high quality pass. */
+void interactive_update(qiv_image *q)
+{
+    fast_render = 1;
+    tile_cache_set_fast(1);
+    if (refine_id)
+        g_source_remove(refine_id);
+    refine_id = g_timeout_add(REFINE_DELAY, render_refine, q);
+}
+
+/* Whether the frame on screen is a fast preview */
+static int showing_preview(qiv_image *q)
+{
+    if (q->tiled || !scaled_im || scaled_w != q->win_w || scaled_h != q->win_h)
+        return fast_render;
+    return scaled_fast;
+}
+
+/* Make sure the scaled copy matches the window size.  While the user
+ * interacts it is scaled right away with nearest neighbour.  Otherwise
+ * scaling is kicked off in the background and 1 returned: update_image()
+ * is called again with the same mode once it's done, until then the old
+ * frame stays on screen. */
+static int start_async_scale(qiv_image *q, int mode)
+{
+    if (tile_cache_wanted(q) || (double)q->win_w * q->win_h > SCALED_CACHE_MAX)
+        return 0;
+    if (scaled_im && scaled_w == q->win_w && scaled_h == q->win_h)
+        return 0;
+
+    if (fast_render)
+    {
+        DATA32 *data = malloc((size_t)q->win_w * q->win_h * sizeof(DATA32));
+
+        free_scaled_image();
+        scale_nearest(imlib_image_get_data_for_reading_only(), q->orig_w, q->orig_h, data,
+                      q->win_w, q->win_h);
+        install_scaled_image(q, data, q->win_w, q->win_h, 0);
+        /* unscaled, nothing to refine */
+        scaled_fast = q->win_w != q->orig_w || q->win_h != q->orig_h;
+        return 0;
+    }
+
+    if (scale_job_retarget(q->win_w, q->win_h, mode))
+        return 1;
+
+    free_scaled_image();
+    tile_cache_invalidate();
+    q->tiled = 0;
+    scale_job_submit(q, imlib_image_get_data_for_reading_only(), q->orig_w, q->orig_h, q->win_w,
+                     q->win_h, mode);
+    return 1;
+}
+
+/* Same mapping as the imlib color modifier set up above */
+static void build_color_lut(qiv_color_modifier mod, DATA32 lut[3][256])
+{
+    double gamma = MAX(0.01, mod.gamma / 256.0);
+    double contrast = MAX(0.01, mod.contrast / 256.0);
+    int brightness = (int)((mod.brightness - 256) / 256.0 * 255);
+    int i, v;
+
+    for (i = 0; i < 256; i++)
+    {
+        v = (int)(pow(i / 255.0, 1 / gamma) * 255);
+        v = CLAMP(v, 0, 255) + brightness;
+        v = CLAMP(v, 0, 255);
+        v = (int)((v - 127) * contrast + 127);
+        v = CLAMP(v, 0, 255);
+        lut[0][i] = v << 16;
+        lut[1][i] = v << 8;
+        lut[2][i] = v;
+    }
+}
+
+/* Table lookups don't vectorize, but with pre-shifted tables this is
+ * three loads and two ors per pixel and stays in cache. */
+static void apply_color_lut(DATA32 *dst, const DATA32 *src, int n, DATA32 lut[3][256])
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        DATA32 p = src[i];
+        dst[i] = (p & 0xff000000) | lut[0][(p >> 16) & 0xff] | lut[1][(p >> 8) & 0xff] |
+                 lut[2][p & 0xff];
+    }
+}
+
+/* Render the current image at window size into x_pixmap/x_mask.  The
+ * scaled copy is kept, so a later color change only re-runs the LUT
+ * pass and the upload. */
+static void render_scaled_image(qiv_image *q, Pixmap *x_pixmap, Pixmap *x_mask)
+{
+    Imlib_Image orig = imlib_context_get_image();
+    Imlib_Color_Modifier cm = imlib_context_get_color_modifier();
+    int has_alpha = imlib_image_has_alpha();
+    DATA32 lut[3][256];
+    DATA32 *frame;
+
+    if (!scaled_im || scaled_w != q->win_w || scaled_h != q->win_h)
+    {
+        /* too big to keep around or not scaled yet, render straight
+         * from the original */
+        imlib_context_set_anti_alias(!fast_render);
+        imlib_render_pixmaps_for_whole_image_at_size(x_pixmap, x_mask, q->win_w, q->win_h);
+        imlib_context_set_anti_alias(1);
+        return;
+    }
+
+    /* write straight into the shared segment if we can, the mask
+     * still needs imlib */
+    if (!(has_alpha && transparency) && (frame = xshm_frame(q->win, scaled_w, scaled_h)))
+    {
+        if (cm)
+        {
+            build_color_lut(q->mod, lut);
+            apply_color_lut(frame, scaled_data, scaled_w * scaled_h, lut);
+        }
+        else
+        {
+            memcpy(frame, scaled_data, (size_t)scaled_w * scaled_h * sizeof(DATA32));
+        }
+        *x_pixmap = xshm_upload(q->win);
+        *x_mask = None;
+        return;
+    }
+
+    imlib_context_set_color_modifier(NULL);
+    if (!cm)
+    {
+        imlib_context_set_image(scaled_im);
+    }
+    else
+    {
+        const DATA32 *src;
+        DATA32 *dst;
+
+        if (!adjusted_im)
+            adjusted_im = imlib_create_image(scaled_w, scaled_h);
+        build_color_lut(q->mod, lut);
+
+        imlib_context_set_image(scaled_im);
+        src = imlib_image_get_data_for_reading_only();
+        imlib_context_set_image(adjusted_im);
+        imlib_image_set_has_alpha(has_alpha);
+        dst = imlib_image_get_data();
+        apply_color_lut(dst, src, scaled_w * scaled_h, lut);
+        imlib_image_put_back_data(dst);
+    }
+    imlib_render_pixmaps_for_whole_image(x_pixmap, x_mask);
+    imlib_context_set_color_modifier(cm);
+    imlib_context_set_image(orig);
+}
+
 static void setup_win(qiv_image *q)
 {
     GdkWindowAttr attr;
 
     destroy_image(q);
 
+    /* nothing has been asked of the new window yet */
+    q->wm_x = q->wm_y = q->wm_w = q->wm_h = -1;
+    q->drawn_title[0] = '\0';
+
     if (!fullscreen)
     {
         attr.window_type = GDK_WINDOW_TOPLEVEL;
         attr.wclass = GDK_INPUT_OUTPUT;
         attr.event_mask = GDK_ALL_EVENTS_MASK;
+        gint ox, oy, w, h;
+
+        image_area(q, &ox, &oy, &w, &h);
         attr.x = center ? q->win_x : 0;
         attr.y = center ? q->win_y : 0;
-        attr.width = q->win_w;
-        attr.height = q->win_h;
+        attr.width = w;
+        attr.height = h;
         q->win = gdk_window_new(NULL, &attr, GDK_WA_X | GDK_WA_Y);
 
         if (center)
         {
-            GdkGeometry geometry = {.min_width = q->win_w,
-                                    .min_height = q->win_h,
-                                    .max_width = q->win_w,
-                                    .max_height = q->win_h,
+            GdkGeometry geometry = {.min_width = w,
+                                    .min_height = h,
+                                    .max_width = w,
+                                    .max_height = h,
                                     .win_gravity = GDK_GRAVITY_STATIC};
             gdk_window_set_geometry_hints(
                 q->win, &geometry, GDK_HINT_MIN_SIZE | GDK_HINT_MAX_SIZE | GDK_HINT_WIN_GRAVITY);
-            gdk_window_move_resize(q->win, q->win_x, q->win_y, q->win_w, q->win_h);
+            gdk_window_move_resize(q->win, q->win_x, q->win_y, w, h);
         }
         else
         {
             GdkGeometry geometry = {
-                .min_width = q->win_w,
-                .min_height = q->win_h,
-                .max_width = q->win_w,
-                .max_height = q->win_h,
+                .min_width = w,
+                .min_height = h,
+                .max_width = w,
+                .max_height = h,
             };
             gdk_window_set_geometry_hints(q->win, &geometry, GDK_HINT_MIN_SIZE | GDK_HINT_MAX_SIZE);
-            gdk_window_resize(q->win, q->win_w, q->win_h);
+            gdk_window_resize(q->win, w, h);
         }
         if (!(to_root || to_root_t || to_root_s))
             gdk_window_lower(q->win);
@@ -400,69 +764,103 @@ static void setup_win(qiv_image *q)
 
 /* set image as background */
 
-void set_desktop_image(qiv_image *q)
+/* Size of the image on monitor mon for the centered background */
+static void root_fit(qiv_image *q, GdkRectangle *mon, gint *w, gint *h)
 {
-    GdkWindow *root_win = gdk_get_default_root_window();
-    GdkVisual *gvis = gdk_drawable_get_visual(root_win);
-    GdkPixmap *temp;
-    gchar *buffer;
-
-    gint root_w = screen_x, root_h = screen_y;
-    gint root_x = 0, root_y = 0;
-
-    Pixmap x_pixmap, x_mask;
+    double f;
 
-    if (to_root || to_root_t)
+    *w = q->win_w;
+    *h = q->win_h;
+    if (maxpect || (scale_down && (q->orig_w > mon->width || q->orig_h > mon->height)))
     {
-        root_w = q->win_w;
-        root_h = q->win_h;
+        f = MIN((double)mon->width / q->orig_w, (double)mon->height / q->orig_h);
+        *w = MAX(1, (gint)(q->orig_w * f));
+        *h = MAX(1, (gint)(q->orig_h * f));
     }
+}
 
-    if (to_root)
-    {
-        root_x = (screen_x - root_w) / 2;
-        root_y = (screen_y - root_h) / 2;
-    }
+/* Compose the background in a root sized pixmap: filled with the
+ * background color, the image centered, tiled or stretched on every
+ * monitor. */
+GdkPixmap *root_compose(qiv_image *q)
+{
+    GdkWindow *root_win = gdk_get_default_root_window();
+    GdkPixmap *root_p, *p;
+    GdkGC *rootGC;
+    gint i, w, h;
 
     setup_imlib_for_drawable(GDK_DRAWABLE(root_win));
 
-    imlib_render_pixmaps_for_whole_image_at_size(&x_pixmap, &x_mask, root_w, root_h);
-#ifdef DEBUG
-    if (x_mask)
-        g_print("*** image has transparency\n");
-#endif
+    root_p = gdk_pixmap_new(root_win, screen_x, screen_y, -1);
+    rootGC = gdk_gc_new(root_p);
+    gdk_gc_set_foreground(rootGC, &image_bg);
+    gdk_draw_rectangle(root_p, rootGC, 1, 0, 0, screen_x, screen_y);
 
-    if (x_pixmap)
+    for (i = 0; i < num_monitors; i++)
     {
-        GdkPixmap *p = gdk_pixmap_foreign_new(x_pixmap);
-        gdk_drawable_set_colormap(GDK_DRAWABLE(p),
-                                  gdk_drawable_get_colormap(GDK_DRAWABLE(root_win)));
+        GdkRectangle *mon = &monitor[i];
+
+        if (to_root_s)
+        {
+            w = mon->width;
+            h = mon->height;
+        }
+        else if (to_root)
+        {
+            root_fit(q, mon, &w, &h);
+        }
+        else
+        {
+            w = q->win_w;
+            h = q->win_h;
+        }
+
         if (to_root_t)
         {
-            gdk_window_set_back_pixmap(root_win, p, FALSE);
+            Pixmap x_pixmap, x_mask;
+
+            imlib_render_pixmaps_for_whole_image_at_size(&x_pixmap, &x_mask, w, h);
+            if (!x_pixmap)
+                continue;
+            p = gdk_pixmap_foreign_new(x_pixmap);
+
+            /* tiles start at the top left of each monitor */
+            gdk_gc_set_fill(rootGC, GDK_TILED);
+            gdk_gc_set_tile(rootGC, p);
+            gdk_gc_set_ts_origin(rootGC, mon->x, mon->y);
+            gdk_draw_rectangle(root_p, rootGC, 1, mon->x, mon->y, mon->width, mon->height);
+            gdk_gc_set_fill(rootGC, GDK_SOLID);
+            g_object_unref(p);
+            imlib_free_pixmap_and_mask(x_pixmap);
         }
         else
         {
-            GdkGC *rootGC;
-            buffer = calloc(1, screen_x * screen_y * gdk_visual_get_depth(gvis) / 8);
-            rootGC = gdk_gc_new(root_win);
-            temp = gdk_pixmap_create_from_data(root_win, buffer, screen_x, screen_y,
-                                               gdk_visual_get_depth(gvis), &image_bg, &image_bg);
-            gdk_drawable_set_colormap(GDK_DRAWABLE(temp),
-                                      gdk_drawable_get_colormap(GDK_DRAWABLE(root_win)));
-            gdk_draw_drawable(temp, rootGC, p, 0, 0, root_x, root_y, root_w, root_h);
-            gdk_window_set_back_pixmap(root_win, temp, FALSE);
-            g_object_unref(temp);
-            g_object_unref(rootGC);
-            free(buffer);
+            /* straight into the root pixmap, no staging copy */
+            imlib_context_set_drawable(GDK_PIXMAP_XID(root_p));
+            imlib_render_image_on_drawable_at_size(mon->x + (mon->width - w) / 2,
+                                                   mon->y + (mon->height - h) / 2, w, h);
         }
-        g_object_unref(p);
-        imlib_free_pixmap_and_mask(x_pixmap);
     }
+
+    g_object_unref(rootGC);
+    setup_imlib_for_drawable(q->win);
+    return root_p;
+}
+
+/* Make the composed pixmap the background in one go */
+void root_install(GdkPixmap *root_p)
+{
+    GdkWindow *root_win = gdk_get_default_root_window();
+
+    gdk_window_set_back_pixmap(root_win, root_p, FALSE);
+    g_object_unref(root_p);
     gdk_window_clear(root_win);
     gdk_flush();
+}
 
-    setup_imlib_for_drawable(q->win);
+void set_desktop_image(qiv_image *q)
+{
+    root_install(root_compose(q));
 }
 
 void zoom_in(qiv_image *q)
@@ -548,10 +946,55 @@ void zoom_out(qiv_image *q)
     }
 }
 
+/* The space an image is fitted into: the letterbox window if there is
+ * one, otherwise the monitor */
+static void fit_size(qiv_image *q, gint *w, gint *h)
+{
+    if (letterbox_w && !fullscreen)
+    {
+        *w = letterbox_w;
+        *h = letterbox_h;
+    }
+    else
+    {
+        *w = monitor[q->mon_id].width;
+        *h = monitor[q->mon_id].height;
+    }
+}
+
+/* Where the image is drawn in the window and how big the window is */
+void image_area(qiv_image *q, gint *ox, gint *oy, gint *area_w, gint *area_h)
+{
+    if (fullscreen)
+    {
+        *ox = q->win_x;
+        *oy = q->win_y;
+        *area_w = monitor[q->mon_id].width;
+        *area_h = monitor[q->mon_id].height;
+    }
+    else if (letterbox_w)
+    {
+        *ox = (letterbox_w - q->win_w) / 2;
+        *oy = (letterbox_h - q->win_h) / 2;
+        *area_w = letterbox_w;
+        *area_h = letterbox_h;
+    }
+    else
+    {
+        *ox = *oy = 0;
+        *area_w = q->win_w;
+        *area_h = q->win_h;
+    }
+}
+
 void zoom_maxpect(qiv_image *q)
 {
-    double zx = (double)monitor[q->mon_id].width / (double)q->orig_w;
-    double zy = (double)monitor[q->mon_id].height / (double)q->orig_h;
+    gint fit_w, fit_h;
+    double zx, zy;
+
+    fit_size(q, &fit_w, &fit_h);
+    zx = (double)fit_w / (double)q->orig_w;
+    zy = (double)fit_h / (double)q->orig_h;
 
     /* titlebar and frames ignored on purpose to use full height/width of screen */
     q->win_w = (gint)(q->orig_w * MIN(zx, zy));
@@ -571,15 +1014,12 @@ void reload_image(qiv_image *q)
 
     imlib_image_set_changes_on_disk();
 
-    im = im_from_pixbuf_loader(image_names[image_idx], &has_alpha);
+    im = im_from_pixbuf_loader(image_path(image_idx), &has_alpha);
 
     if (!im && watch_file)
         return;
 
-    struct stat statbuf;
-    stat(image_names[image_idx], &statbuf);
-    current_mtime = statbuf.st_mtime;
-
+    discard_scaled_image();
     if (imlib_context_get_image())
         imlib_free_image();
 
@@ -600,6 +1040,7 @@ void reload_image(qiv_image *q)
         q->orig_w = imlib_image_get_width();
         q->orig_h = imlib_image_get_height();
     }
+    q->view_rot = q->view_flip = 0;
 
     q->win_w = (gint)(q->orig_w * (1 + zoom_factor * 0.1));
     q->win_h = (gint)(q->orig_h * (1 + zoom_factor * 0.1));
@@ -610,8 +1051,10 @@ void reload_image(qiv_image *q)
 
 void check_size(qiv_image *q, gint reset)
 {
-    if (maxpect || (scale_down && (q->orig_w > monitor[q->mon_id].width ||
-                                   q->orig_h > monitor[q->mon_id].height)))
+    gint fit_w, fit_h;
+
+    fit_size(q, &fit_w, &fit_h);
+    if (maxpect || (scale_down && (q->orig_w > fit_w || q->orig_h > fit_h)))
     {
         zoom_maxpect(q);
     }
@@ -654,11 +1097,115 @@ void reset_coords(qiv_image *q)
     }
 }
 
+static void damage_rect(GdkRegion *d, gint x, gint y, gint w, gint h)
+{
+    GdkRectangle r = {x, y, w, h};
+
+    gdk_region_union_with_rect(d, &r);
+}
+
+/* Work out what changed since the last fullscreen frame: the old and
+ * new image position, the statusbar and the comment box.  Areas that
+ * overlays were drawn over are in q->damage already.  Also (re)creates
+ * the back buffer if the monitor changed. */
+static GdkRegion *fullscreen_damage(qiv_image *q, int mode)
+{
+    gint w = monitor[q->mon_id].width, h = monitor[q->mon_id].height;
+    GdkRegion *d = q->damage ? q->damage : gdk_region_new();
+    gint bw = 0, bh = 0;
+    int title_changed = strcmp(q->drawn_title, q->win_title) != 0;
+    int comment_on = comment && comment_window;
+
+    q->damage = NULL;
+    if (q->back)
+        gdk_drawable_get_size(q->back, &bw, &bh);
+    if (bw != w || bh != h)
+    {
+        if (q->back)
+            g_object_unref(q->back);
+        q->back = gdk_pixmap_new(q->win, w, h, -1);
+        mode = FULL_REDRAW;
+    }
+
+    if (mode == FULL_REDRAW)
+    {
+        damage_rect(d, 0, 0, w, h);
+        return d;
+    }
+
+    if (magnify_img.shown)
+        damage_rect(d, magnify_img.win_x, magnify_img.win_y, magnify_img.win_w,
+                    magnify_img.win_h);
+
+    if (mode != MIN_REDRAW)
+    {
+        damage_rect(d, q->win_ox, q->win_oy, q->win_ow, q->win_oh);
+        damage_rect(d, q->win_x, q->win_y, q->win_w, q->win_h);
+    }
+    if (title_changed || q->statusbar_was_on != statusbar_fullscreen)
+    {
+        if (q->statusbar_was_on)
+            damage_rect(d, w - q->text_ow - 10, h - q->text_oh - 10, q->text_ow + 6,
+                        q->text_oh + 6);
+        if (statusbar_fullscreen)
+            damage_rect(d, w - q->text_w - 10, h - q->text_h - 10, q->text_w + 6, q->text_h + 6);
+    }
+    if (q->comment_was_on != comment_on || q->comment_ow != q->comment_w ||
+        q->comment_oh != q->comment_h)
+    {
+        if (q->comment_was_on)
+            damage_rect(d, 25, h - q->comment_oh - 30, q->comment_ow + 6, q->comment_oh + 6);
+        if (comment_on)
+            damage_rect(d, 25, h - q->comment_h - 30, q->comment_w + 6, q->comment_h + 6);
+    }
+    return d;
+}
+
+static void set_clip(qiv_image *q, GdkRegion *clip)
+{
+    gdk_gc_set_clip_region(q->bg_gc, clip);
+    gdk_gc_set_clip_region(q->text_gc, clip);
+    gdk_gc_set_clip_region(q->status_gc, clip);
+    gdk_gc_set_clip_region(q->comment_gc, clip);
+}
+
+/* Overlays like the text window are drawn here: the back buffer in
+ * fullscreen, the window otherwise. */
+GdkDrawable *overlay_target(qiv_image *q)
+{
+    return fullscreen && q->back ? q->back : q->win;
+}
+
+/* Show an overlay drawn into overlay_target().  The area is restored
+ * with the next frame. */
+void present_overlay(qiv_image *q, gint x, gint y, gint w, gint h)
+{
+    if (overlay_target(q) != q->back)
+        return;
+    gdk_draw_drawable(q->win, q->bg_gc, q->back, x, y, x, y, w, h);
+    if (!q->damage)
+        q->damage = gdk_region_new();
+    damage_rect(q->damage, x, y, w, h);
+}
+
+/* Move and resize the window unless it is there already */
+static void move_resize(qiv_image *q, gint x, gint y, gint w, gint h)
+{
+    if (x == q->wm_x && y == q->wm_y && w == q->wm_w && h == q->wm_h)
+        return;
+    gdk_window_move_resize(q->win, x, y, w, h);
+    q->wm_x = x;
+    q->wm_y = y;
+    q->wm_w = w;
+    q->wm_h = h;
+}
+
 /* Something changed the image.  Redraw it. */
 
 void update_image(qiv_image *q, int mode)
 {
     static GdkPixmap *m = NULL;
+    GdkPixmap *statusbar_pix = NULL, *comment_pix = NULL;
     Pixmap x_pixmap, x_mask;
     double elapsed = 0;
     struct timeval before, after;
@@ -667,14 +1214,15 @@ void update_image(qiv_image *q, int mode)
     if (q->error)
     {
         g_snprintf(q->win_title, sizeof q->win_title, "qiv: ERROR! cannot load image: %s",
-                   image_names[image_idx]);
+                   image_path(image_idx));
         gdk_beep();
 
         /* take this image out of the file list */
+        list_removed(image_list[image_idx]);
         --images;
         for (i = image_idx; i < images; ++i)
         {
-            image_names[i] = image_names[i + 1];
+            image_list[i] = image_list[i + 1];
         }
 
         /* If deleting the last file out of x */
@@ -682,7 +1230,7 @@ void update_image(qiv_image *q, int mode)
             image_idx = 0;
 
         /* If deleting the only file left */
-        if (!images)
+        if (!images && !list_wait())
         {
 #ifdef DEBUG
             g_print("*** deleted last file in list. Exiting.\n");
@@ -700,30 +1248,15 @@ void update_image(qiv_image *q, int mode)
 
         if (mode == MOVED)
         {
-            if (transparency && used_masks_before)
-            {
-                /* there should be a faster way to update the mask, but how? */
-                if (q->p)
-                {
-                    imlib_free_pixmap_and_mask(GDK_PIXMAP_XID(q->p));
-                    g_object_unref(q->p);
-                }
-                if (m)
-                    g_object_unref(m);
-                imlib_render_pixmaps_for_whole_image_at_size(&x_pixmap, &x_mask, q->win_w,
-                                                             q->win_h);
-                q->p = gdk_pixmap_foreign_new(x_pixmap);
-                gdk_drawable_set_colormap(GDK_DRAWABLE(q->p),
-                                          gdk_drawable_get_colormap(GDK_DRAWABLE(q->win)));
-                m = gdk_pixmap_foreign_new(x_mask);
-            }
-
+            /* pixmap and mask are unchanged, the mask is shifted to the
+             * new position below */
             g_snprintf(q->win_title, sizeof q->win_title,
-                       "qiv: %s (%dx%d) %d%% [%d/%d] b%d/c%d/g%d %s", image_names[image_idx],
+                       "qiv: %s (%dx%d) %d%% %s [%d/%d%s] b%d/c%d/g%d %s", image_path(image_idx),
                        q->orig_w, q->orig_h,
                        myround((1.0 - (q->orig_w - q->win_w) / (double)q->orig_w) * 100),
-                       image_idx + 1, images, q->mod.brightness / 8 - 32, q->mod.contrast / 8 - 32,
-                       q->mod.gamma / 8 - 32, infotext);
+                       showing_preview(q) ? "fast" : "hq", image_idx + 1, list_total(),
+                       list_building() ? "+" : "", q->mod.brightness / 8 - 32,
+                       q->mod.contrast / 8 - 32, q->mod.gamma / 8 - 32, infotext);
             snprintf(infotext, sizeof infotext, "(-)");
 
         } // mode == MOVED
@@ -732,6 +1265,13 @@ void update_image(qiv_image *q, int mode)
             if (mode != MIN_REDRAW)
             {
                 GdkPixmap *pix_ptr = NULL;
+                /* zoom on the X server once the level for it is uploaded,
+                 * until then scale on the client as without RENDER */
+                int server_side = !tile_cache_wanted(q) && xrender_prepare(q);
+
+                if (!server_side && start_async_scale(q, mode))
+                    return;
+
                 if (q->p)
                 {
                     imlib_free_pixmap_and_mask(GDK_PIXMAP_XID(q->p));
@@ -739,31 +1279,47 @@ void update_image(qiv_image *q, int mode)
                 }
                 if (m)
                     g_object_unref(m);
-
-                /* calculate elapsed time while we render image */
-                gettimeofday(&before, 0);
-                imlib_render_pixmaps_for_whole_image_at_size(&x_pixmap, &x_mask, q->win_w,
-                                                             q->win_h);
-                gettimeofday(&after, 0);
-                elapsed = ((after.tv_sec + after.tv_usec / 1.0e6) -
-                           (before.tv_sec + before.tv_usec / 1.0e6));
-
-                pix_ptr = gdk_pixmap_lookup(x_pixmap);
-                if (pix_ptr == NULL)
+                q->p = NULL;
+                m = NULL;
+
+                /* zoom or colors changed, cached tiles are stale */
+                tile_cache_invalidate();
+                magnify_invalidate(&magnify_img);
+                q->tiled = tile_cache_wanted(q);
+                if (!q->tiled)
                 {
-                    q->p =
-                        gdk_pixmap_foreign_new_for_screen(screen, x_pixmap, q->win_w, q->win_h, 24);
+                    /* calculate elapsed time while we render image */
+                    gettimeofday(&before, 0);
+                    if (server_side)
+                    {
+                        x_pixmap = xrender_render(q, fast_render);
+                        x_mask = None;
+                    }
+                    else
+                    {
+                        render_scaled_image(q, &x_pixmap, &x_mask);
+                    }
+                    gettimeofday(&after, 0);
+                    elapsed = ((after.tv_sec + after.tv_usec / 1.0e6) -
+                               (before.tv_sec + before.tv_usec / 1.0e6));
+
+                    pix_ptr = gdk_pixmap_lookup(x_pixmap);
+                    if (pix_ptr == NULL)
+                    {
+                        q->p = gdk_pixmap_foreign_new_for_screen(screen, x_pixmap, q->win_w,
+                                                                 q->win_h, 24);
+                    }
+                    else
+                    {
+                        q->p = pix_ptr;
+                        g_object_ref(q->p);
+                    }
+                    gdk_drawable_set_colormap(GDK_DRAWABLE(q->p),
+                                              gdk_drawable_get_colormap(GDK_DRAWABLE(q->win)));
+                    m = x_mask == None ? NULL
+                                       : gdk_pixmap_foreign_new_for_screen(screen, x_mask, q->win_w,
+                                                                           q->win_h, 1);
                 }
-                else
-                {
-                    q->p = pix_ptr;
-                    g_object_ref(q->p);
-                }
-                gdk_drawable_set_colormap(GDK_DRAWABLE(q->p),
-                                          gdk_drawable_get_colormap(GDK_DRAWABLE(q->win)));
-                m = x_mask == None
-                        ? NULL
-                        : gdk_pixmap_foreign_new_for_screen(screen, x_mask, q->win_w, q->win_h, 1);
             }
 
 #ifdef DEBUG
@@ -772,36 +1328,43 @@ void update_image(qiv_image *q, int mode)
 #endif
 
             g_snprintf(q->win_title, sizeof q->win_title,
-                       "qiv: %s (%dx%d) %1.01fs %d%% [%d/%d] b%d/c%d/g%d %s",
-                       image_names[image_idx], q->orig_w, q->orig_h, load_elapsed + elapsed,
+                       "qiv: %s (%dx%d) %1.01fs %d%% %s [%d/%d%s] b%d/c%d/g%d %s",
+                       image_path(image_idx), q->orig_w, q->orig_h,
+                       load_elapsed + scale_elapsed + elapsed,
                        myround((1.0 - (q->orig_w - q->win_w) / (double)q->orig_w) * 100),
-                       image_idx + 1, images, q->mod.brightness / 8 - 32, q->mod.contrast / 8 - 32,
-                       q->mod.gamma / 8 - 32, infotext);
+                       showing_preview(q) ? "fast" : "hq", image_idx + 1, list_total(),
+                       list_building() ? "+" : "", q->mod.brightness / 8 - 32,
+                       q->mod.contrast / 8 - 32, q->mod.gamma / 8 - 32, infotext);
             snprintf(infotext, sizeof infotext, "(-)");
+            scale_elapsed = 0;
         }
     }
 
-    gdk_window_set_title(q->win, q->win_title);
+    /* property changes go to the WM, only send what changed */
+    if (strcmp(q->win_title, q->drawn_title))
+        gdk_window_set_title(q->win, q->win_title);
 
+    /* laid out again only if the text changed */
     q->text_len = strlen(q->win_title);
-    pango_layout_set_text(layout, q->win_title, -1);
-    pango_layout_get_pixel_size(layout, &(q->text_w), &(q->text_h));
-
+    if (fullscreen ? statusbar_fullscreen : statusbar_window)
+        statusbar_pix = overlay_statusbar(q);
     if (comment && comment_window)
-    {
-        pango_layout_set_text(layoutComment, comment, -1);
-        pango_layout_get_pixel_size(layoutComment, &(q->comment_w), &(q->comment_h));
-    }
+        comment_pix = overlay_comment(q);
 
     if (!fullscreen)
     {
-        GdkGeometry geometry = {.min_width = q->win_w,
-                                .min_height = q->win_h,
-                                .max_width = q->win_w,
-                                .max_height = q->win_h,
-                                .win_gravity = GDK_GRAVITY_STATIC};
-        gdk_window_set_geometry_hints(q->win, &geometry,
-                                      GDK_HINT_MIN_SIZE | GDK_HINT_MAX_SIZE | GDK_HINT_WIN_GRAVITY);
+        gint ox, oy, area_w, area_h;
+        GdkGeometry geometry = {.win_gravity = GDK_GRAVITY_STATIC};
+        GdkPixmap *bg = q->p;
+
+        /* the window has the size of the image, or of the letterbox */
+        image_area(q, &ox, &oy, &area_w, &area_h);
+        geometry.min_width = geometry.max_width = area_w;
+        geometry.min_height = geometry.max_height = area_h;
+        if (area_w != q->wm_w || area_h != q->wm_h)
+            gdk_window_set_geometry_hints(q->win, &geometry,
+                                          GDK_HINT_MIN_SIZE | GDK_HINT_MAX_SIZE |
+                                              GDK_HINT_WIN_GRAVITY);
 
         if (first)
         {
@@ -811,16 +1374,34 @@ void update_image(qiv_image *q, int mode)
         }
 
         if (mode != MIN_REDRAW)
-            gdk_window_move_resize(q->win, q->win_x, q->win_y, q->win_w, q->win_h);
+            move_resize(q, q->win_x, q->win_y, area_w, area_h);
 
-        if (!q->error)
+        if (!q->error && q->p)
         {
-            gdk_window_set_back_pixmap(q->win, q->p, FALSE);
+            if (letterbox_w)
+            {
+                /* the image on the background color, in a pixmap kept
+                 * for the window's lifetime */
+                gint bw = 0, bh = 0;
+
+                if (q->back)
+                    gdk_drawable_get_size(q->back, &bw, &bh);
+                if (bw != area_w || bh != area_h)
+                {
+                    if (q->back)
+                        g_object_unref(q->back);
+                    q->back = gdk_pixmap_new(q->win, area_w, area_h, -1);
+                }
+                gdk_draw_rectangle(q->back, q->bg_gc, 1, 0, 0, area_w, area_h);
+                gdk_draw_drawable(q->back, q->bg_gc, q->p, 0, 0, ox, oy, -1, -1);
+                bg = q->back;
+            }
+            gdk_window_set_back_pixmap(q->win, bg, FALSE);
             /* remove or set transparency mask */
             if (used_masks_before)
             {
                 if (transparency)
-                    gdk_window_shape_combine_mask(q->win, m, 0, 0);
+                    gdk_window_shape_combine_mask(q->win, m, ox, oy);
                 else
                     gdk_window_shape_combine_mask(q->win, 0, 0, 0);
             }
@@ -828,7 +1409,7 @@ void update_image(qiv_image *q, int mode)
             {
                 if (transparency && m)
                 {
-                    gdk_window_shape_combine_mask(q->win, m, 0, 0);
+                    gdk_window_shape_combine_mask(q->win, m, ox, oy);
                     used_masks_before = 1;
                 }
             }
@@ -838,29 +1419,19 @@ void update_image(qiv_image *q, int mode)
         if (statusbar_window)
         {
 #ifdef DEBUG
-            g_print("*** print statusbar at (%d, %d)\n", MAX(2, q->win_w - q->text_w - 10),
-                    MAX(2, q->win_h - q->text_h - 10));
+            g_print("*** print statusbar at (%d, %d)\n", MAX(2, area_w - q->text_w - 10),
+                    MAX(2, area_h - q->text_h - 10));
 #endif
-            gdk_draw_rectangle(q->win, q->bg_gc, 0, MAX(2, q->win_w - q->text_w - 10),
-                               MAX(2, q->win_h - q->text_h - 10), q->text_w + 5, q->text_h + 5);
-            gdk_draw_rectangle(q->win, q->status_gc, 1, MAX(3, q->win_w - q->text_w - 9),
-                               MAX(3, q->win_h - q->text_h - 9), q->text_w + 4, q->text_h + 4);
-
-            gdk_draw_layout(q->win, q->text_gc, MAX(5, q->win_w - q->text_w - 7),
-                            MAX(5, q->win_h - 7 - q->text_h), layout);
+            gdk_draw_drawable(q->win, q->bg_gc, statusbar_pix, 0, 0,
+                              MAX(2, area_w - q->text_w - 10), MAX(2, area_h - q->text_h - 10),
+                              -1, -1);
         }
 
         if (comment && comment_window)
         {
             /* draw comment */
-            gdk_draw_rectangle(q->win, q->bg_gc, 0, 25, MAX(5, q->win_h - q->comment_h - 30),
-                               q->comment_w + 5, q->comment_h + 5);
-
-            gdk_draw_rectangle(q->win, q->comment_gc, 1, 26, MAX(6, q->win_h - q->comment_h - 29),
-                               q->comment_w + 4, q->comment_h + 4);
-
-            gdk_draw_layout(q->win, q->text_gc, 27, MAX(5, q->win_h - 27 - q->comment_h),
-                            layoutComment);
+            gdk_draw_drawable(q->win, q->bg_gc, comment_pix, 0, 0, 25,
+                              MAX(5, area_h - q->comment_h - 30), -1, -1);
         }
 
     } // if (!fullscreen)
@@ -868,30 +1439,7 @@ void update_image(qiv_image *q, int mode)
     {
 #define statusbar_x monitor[q->mon_id].width
 #define statusbar_y monitor[q->mon_id].height
-        if (mode == FULL_REDRAW)
-        {
-            gdk_window_clear(q->win);
-        }
-        else
-        {
-            if (q->win_x > q->win_ox)
-                gdk_draw_rectangle(q->win, q->bg_gc, 1, q->win_ox, q->win_oy, q->win_x - q->win_ox,
-                                   q->win_oh);
-            if (q->win_y > q->win_oy)
-                gdk_draw_rectangle(q->win, q->bg_gc, 1, q->win_ox, q->win_oy, q->win_ow,
-                                   q->win_y - q->win_oy);
-            if (q->win_x + q->win_w < q->win_ox + q->win_ow)
-                gdk_draw_rectangle(q->win, q->bg_gc, 1, q->win_x + q->win_w, q->win_oy,
-                                   q->win_ox + q->win_ow, q->win_oh);
-            if (q->win_y + q->win_h < q->win_oy + q->win_oh)
-                gdk_draw_rectangle(q->win, q->bg_gc, 1, q->win_ox, q->win_y + q->win_h, q->win_ow,
-                                   q->win_oy + q->win_oh);
-
-            if (q->statusbar_was_on &&
-                (!statusbar_fullscreen || q->text_ow > q->text_w || q->text_oh > q->text_h))
-                gdk_draw_rectangle(q->win, q->bg_gc, 1, statusbar_x - q->text_ow - 9,
-                                   statusbar_y - q->text_oh - 9, q->text_ow + 4, q->text_oh + 4);
-        }
+        GdkRegion *damage = fullscreen_damage(q, mode);
 
         /* remove or set transparency mask */
         if (used_masks_before)
@@ -910,33 +1458,37 @@ void update_image(qiv_image *q, int mode)
             }
         }
 
+        /* compose the damaged area in the back buffer, then show it
+         * with a single copy */
+        set_clip(q, damage);
+        gdk_draw_rectangle(q->back, q->bg_gc, 1, 0, 0, statusbar_x, statusbar_y);
+
         if (!q->error)
-            gdk_draw_drawable(q->win, q->bg_gc, q->p, 0, 0, q->win_x, q->win_y, q->win_w, q->win_h);
+        {
+            if (q->tiled)
+                tile_cache_draw(q, q->back, mode == MOVED ? q->win_x - q->win_ox : 0,
+                                mode == MOVED ? q->win_y - q->win_oy : 0);
+            else if (q->p)
+                gdk_draw_drawable(q->back, q->bg_gc, q->p, 0, 0, q->win_x, q->win_y, -1, -1);
+        }
 
         if (statusbar_fullscreen)
         {
-            gdk_draw_rectangle(q->win, q->bg_gc, 0, statusbar_x - q->text_w - 10,
-                               statusbar_y - q->text_h - 10, q->text_w + 5, q->text_h + 5);
-
-            gdk_draw_rectangle(q->win, q->status_gc, 1, statusbar_x - q->text_w - 9,
-                               statusbar_y - q->text_h - 9, q->text_w + 4, q->text_h + 4);
-
-            gdk_draw_layout(q->win, q->text_gc, statusbar_x - q->text_w - 7,
-                            statusbar_y - 7 - q->text_h, layout);
+            gdk_draw_drawable(q->back, q->bg_gc, statusbar_pix, 0, 0, statusbar_x - q->text_w - 10,
+                              statusbar_y - q->text_h - 10, -1, -1);
         }
 
         if (comment && comment_window)
         {
             /* draw comment */
-            gdk_draw_rectangle(q->win, q->bg_gc, 0, 25, statusbar_y - q->comment_h - 30,
-                               q->comment_w + 5, q->comment_h + 5);
-
-            gdk_draw_rectangle(q->win, q->comment_gc, 1, 26, statusbar_y - q->comment_h - 29,
-                               q->comment_w + 4, q->comment_h + 4);
-
-            gdk_draw_layout(q->win, q->text_gc, 27, statusbar_y - 27 - q->comment_h, layoutComment);
+            gdk_draw_drawable(q->back, q->bg_gc, comment_pix, 0, 0, 25,
+                              statusbar_y - q->comment_h - 30, -1, -1);
         }
 
+        gdk_draw_drawable(q->win, q->bg_gc, q->back, 0, 0, 0, 0, -1, -1);
+        set_clip(q, NULL);
+        gdk_region_destroy(damage);
+
         q->win_ox = q->win_x;
         q->win_oy = q->win_y;
         q->win_ow = q->win_w;
@@ -944,6 +1496,9 @@ void update_image(qiv_image *q, int mode)
         q->text_ow = q->text_w;
         q->text_oh = q->text_h;
         q->statusbar_was_on = statusbar_fullscreen;
+        q->comment_ow = q->comment_w;
+        q->comment_oh = q->comment_h;
+        q->comment_was_on = comment && comment_window;
 
         if (first)
         {
@@ -951,10 +1506,48 @@ void update_image(qiv_image *q, int mode)
             first = 0;
         }
 
-        gdk_window_move_resize(q->win, monitor[q->mon_id].x, monitor[q->mon_id].y,
-                               monitor[q->mon_id].width, monitor[q->mon_id].height);
+        move_resize(q, monitor[q->mon_id].x, monitor[q->mon_id].y, monitor[q->mon_id].width,
+                    monitor[q->mon_id].height);
     }
-    gdk_flush();
+    g_strlcpy(q->drawn_title, q->win_title, sizeof q->drawn_title);
+
+    /* the frame was drawn over the lens */
+    if (magnify && magnify_img.shown)
+    {
+        magnify_img.shown = 0;
+        magnify_draw(q, &magnify_img);
+    }
+    /* no need to wait for the server */
+    gdk_display_flush(gdk_drawable_get_display(q->win));
+}
+
+/* Repaint an exposed area from what is already rendered: the back
+ * buffer in fullscreen.  In a window the server restores the image from
+ * the background pixmap, only the overlays are put back on top. */
+void expose_image(qiv_image *q, GdkRectangle *area)
+{
+    gint ox, oy, area_w, area_h;
+
+    if (fullscreen)
+    {
+        if (q->back)
+            gdk_draw_drawable(q->win, q->bg_gc, q->back, area->x, area->y, area->x, area->y,
+                              area->width, area->height);
+        else
+            update_image(q, FULL_REDRAW);
+        return;
+    }
+
+    image_area(q, &ox, &oy, &area_w, &area_h);
+    gdk_gc_set_clip_rectangle(q->bg_gc, area);
+    if (statusbar_window)
+        gdk_draw_drawable(q->win, q->bg_gc, overlay_statusbar(q), 0, 0,
+                          MAX(2, area_w - q->text_w - 10), MAX(2, area_h - q->text_h - 10), -1,
+                          -1);
+    if (comment && comment_window)
+        gdk_draw_drawable(q->win, q->bg_gc, overlay_comment(q), 0, 0, 25,
+                          MAX(5, area_h - q->comment_h - 30), -1, -1);
+    gdk_gc_set_clip_rectangle(q->bg_gc, NULL);
 }
 
 void reset_mod(qiv_image *q)
@@ -966,6 +1559,7 @@ void reset_mod(qiv_image *q)
 
 void destroy_image(qiv_image *q)
 {
+    tile_cache_invalidate();
     if (q->p)
     {
         imlib_free_pixmap_and_mask(GDK_PIXMAP_XID(q->p));
@@ -981,6 +1575,10 @@ void destroy_image(qiv_image *q)
         g_object_unref(q->status_gc);
     if (q->comment_gc)
         g_object_unref(q->comment_gc);
+    if (q->back)
+        g_object_unref(q->back);
+    if (q->damage)
+        gdk_region_destroy(q->damage);
 
     q->p = NULL;
     q->win = NULL;
@@ -988,119 +1586,175 @@ void destroy_image(qiv_image *q)
     q->text_gc = NULL;
     q->status_gc = NULL;
     q->comment_gc = NULL;
+    q->back = NULL;
+    q->damage = NULL;
 }
 
-void setup_magnify(qiv_image *q, qiv_mgl *m)
+/* The magnifying glass is drawn into the main window.  It is copied
+ * from a pre-scaled buffer MAGNIFY_CACHE times the lens size around
+ * the cursor, which is only rendered again when the lens leaves it or
+ * the zoom changes.  Cursor motion is paced like dragging. */
+
+static qiv_image *magnify_owner;
+static gint64 magnify_last_frame;
+
+static void magnify_invalidate(qiv_mgl *m)
 {
-    GdkWindowAttr mgl_attr;
-    GdkGeometry mgl_hints;
+    m->buf_zoom = 0;
+}
 
+void setup_magnify(qiv_image *q, qiv_mgl *m)
+{
     m->win_w = 300;
     m->win_h = 200;
     m->zoom = 2.0;
+    m->shown = 0;
+    if (m->p)
+        g_object_unref(m->p);
+    m->p = gdk_pixmap_new(q->win, m->win_w * MAGNIFY_CACHE, m->win_h * MAGNIFY_CACHE, -1);
+    magnify_invalidate(m);
+}
 
-    //   gdk_flush();
-    gdk_window_get_root_origin(q->win, &m->frame_x, &m->frame_y);
-    // printf("frame %d %d\n", m->frame_x, m->frame_y);
-
-    mgl_attr.window_type = GDK_WINDOW_TOPLEVEL; // Set up attributes for GDK to create a Window
-    mgl_attr.wclass = GDK_INPUT_OUTPUT;
-    mgl_attr.event_mask = GDK_STRUCTURE_MASK | GDK_EXPOSURE_MASK;
-    mgl_attr.width = m->win_w;
-    mgl_attr.height = m->win_h;
-    mgl_attr.override_redirect = TRUE;
-    //   m->win=gdk_window_new(NULL,&mgl_attr,GDK_WA_X|GDK_WA_Y|GDK_WA_WMCLASS);
-    m->win = gdk_window_new(NULL, &mgl_attr, GDK_WA_X | GDK_WA_Y);
-    mgl_hints.min_width = m->win_w;
-    mgl_hints.max_width = m->win_w;
-    mgl_hints.min_height = m->win_h;
-    mgl_hints.max_height = m->win_h;
-    gdk_window_set_geometry_hints(m->win, &mgl_hints, GDK_HINT_MIN_SIZE | GDK_HINT_MAX_SIZE);
-    gdk_window_set_decorations(m->win, GDK_DECOR_BORDER);
-    gdk_flush();
+/* Render the neighbourhood of image pixel sx/sy into the buffer.  If
+ * the image is smaller than that it gets a border in the background
+ * color. */
+static void magnify_fill(qiv_image *q, qiv_mgl *m, double sx, double sy)
+{
+    gint bw = m->win_w * MAGNIFY_CACHE, bh = m->win_h * MAGNIFY_CACHE;
+    gint src_w = MIN(q->orig_w, (gint)(bw / m->zoom));
+    gint src_h = MIN(q->orig_h, (gint)(bh / m->zoom));
+
+    m->buf_x = CLAMP((gint)(sx - (src_w - m->win_w / m->zoom) / 2), 0, q->orig_w - src_w);
+    m->buf_y = CLAMP((gint)(sy - (src_h - m->win_h / m->zoom) / 2), 0, q->orig_h - src_h);
+    m->buf_zoom = m->zoom;
+
+    gdk_draw_rectangle(m->p, q->bg_gc, 1, 0, 0, bw, bh);
+    imlib_context_set_drawable(GDK_PIXMAP_XID(m->p));
+    imlib_render_image_part_on_drawable_at_size(m->buf_x, m->buf_y, src_w, src_h, 0, 0,
+                                                src_w * m->zoom, src_h * m->zoom);
+    imlib_context_set_drawable(GDK_WINDOW_XID(q->win));
+}
+
+/* Put back what is under the lens, except where it is drawn next */
+static void magnify_restore(qiv_image *q, qiv_mgl *m, GdkRectangle *keep)
+{
+    GdkRectangle old = {m->win_x, m->win_y, m->win_w, m->win_h}, *rects;
+    GdkRegion *r = gdk_region_rectangle(&old);
+    gint i, n;
+
+    if (keep)
+    {
+        GdkRegion *k = gdk_region_rectangle(keep);
+
+        gdk_region_subtract(r, k);
+        gdk_region_destroy(k);
+    }
+    gdk_region_get_rectangles(r, &rects, &n);
+    for (i = 0; i < n; i++)
+    {
+        if (!fullscreen)
+            gdk_window_clear_area(q->win, rects[i].x, rects[i].y, rects[i].width,
+                                  rects[i].height);
+        expose_image(q, &rects[i]);
+    }
+    g_free(rects);
+    gdk_region_destroy(r);
+}
+
+static void magnify_draw(qiv_image *q, qiv_mgl *m)
+{
+    gint ox, oy, area_w, area_h;
+    gint bw = m->win_w * MAGNIFY_CACHE, bh = m->win_h * MAGNIFY_CACHE, bx, by;
+    GdkRectangle lens = {0, 0, m->win_w, m->win_h};
+    double sx, sy;
+
+    if (q->error)
+        return;
+
+    image_area(q, &ox, &oy, &area_w, &area_h);
+    /* image pixel at the top left of the lens, centered on the cursor */
+    sx = (m->xcur - ox) * ((double)q->orig_w / q->win_w) - m->win_w / (2 * m->zoom);
+    sy = (m->ycur - oy) * ((double)q->orig_h / q->win_h) - m->win_h / (2 * m->zoom);
+
+    /* keep magnify part allways inside image */
+    sx = CLAMP(sx, 0, MAX(0, q->orig_w - m->win_w / m->zoom));
+    sy = CLAMP(sy, 0, MAX(0, q->orig_h - m->win_h / m->zoom));
+
+    bx = (gint)((sx - m->buf_x) * m->zoom);
+    by = (gint)((sy - m->buf_y) * m->zoom);
+    if (m->buf_zoom != m->zoom || bx < 0 || by < 0 || bx + m->win_w > bw || by + m->win_h > bh)
+    {
+        magnify_fill(q, m, sx, sy);
+        bx = (gint)((sx - m->buf_x) * m->zoom);
+        by = (gint)((sy - m->buf_y) * m->zoom);
+    }
+
+    /* up left of the cursor, or below/right of it near the edges */
+    lens.x = m->xcur - 50 - m->win_w;
+    lens.y = m->ycur - 50 - m->win_h;
+    if (lens.x < 0)
+        lens.x = MIN(m->xcur + 50, MAX(0, area_w - m->win_w));
+    if (lens.y < 0)
+        lens.y = MIN(m->ycur + 50, MAX(0, area_h - m->win_h));
+
+    if (m->shown)
+        magnify_restore(q, m, &lens);
+    gdk_draw_drawable(q->win, q->bg_gc, m->p, bx, by, lens.x, lens.y, m->win_w, m->win_h);
+    gdk_draw_rectangle(q->win, q->text_gc, 0, lens.x, lens.y, m->win_w - 1, m->win_h - 1);
+    m->win_x = lens.x;
+    m->win_y = lens.y;
+    m->shown = 1;
 }
 
+static gboolean magnify_frame(gpointer data)
+{
+    qiv_mgl *m = data;
+
+    m->frame_id = 0;
+    magnify_last_frame = g_get_monotonic_time();
+    if (magnify)
+        magnify_draw(magnify_owner, m);
+    return FALSE;
+}
+
+/* Move the lens to the cursor at xcur/ycur (window coordinates) */
 void update_magnify(qiv_image *q, qiv_mgl *m, int mode, gint xcur, gint ycur)
 {
-    //   GdkWindowAttr mgl_attr;
-    //   GdkGeometry mgl_hints;
-    register gint xx, yy; // win_pos_x, win_pos_y;
-
-    /***********
-      if (mode == FULL_REDRAW) {
-    //    printf("> update_magnify: FULL_REDRAW \n");
-        m->im=gdk_imlib_crop_and_clone_image(
-          q->im, 0, 0, m->win_w, m->win_h);
-        gdk_imlib_apply_image(m->im,m->win);
-
-        mgl_hints.min_width=m->win_w;
-        mgl_hints.max_width=m->win_w;
-        mgl_hints.min_height=m->win_h;
-        mgl_hints.max_height=m->win_h;
-
-    //    gdk_window_set_hints(m->win, mgl_attr.x, mgl_attr.y,mglw,
-    //                         mglw,mglh, mglh, GDK_HINT_POS | GDK_HINT_MIN_SIZE |
-    GDK_HINT_MAX_SIZE); gdk_window_set_hints(m->win, xcur+50, ycur-50-m->win_h,m->win_w,
-                             m->win_w,m->win_h, m->win_h, GDK_HINT_POS | GDK_HINT_MIN_SIZE |
-    GDK_HINT_MAX_SIZE);
-    //    gdk_window_move_resize(m->win,mgl_attr.x, mgl_attr.y, mglw, mglh);
-
-    //    gdk_window_set_geometry_hints(magnify_img.win, &mgl_hints, GDK_HINT_POS );
-      }
-    ************/
-    if (mode == REDRAW)
-    {
-        /* scale position to original size */
-        xx = xcur * ((double)q->orig_w / (double)q->win_w);
-        yy = ycur * ((double)q->orig_h / (double)q->win_h);
-
-        /* center mouse cursor position */
-        xx -= 150 / m->zoom;
-        yy -= 100 / m->zoom;
-
-        /* keep magnify part allways inside image */
-        if (xx + m->win_w / m->zoom > q->orig_w)
-        {
-            xx = q->orig_w - m->win_w / m->zoom;
-        }
-        if (yy + m->win_h / m->zoom > q->orig_h)
-        {
-            yy = q->orig_h - m->win_h / m->zoom;
-        }
+    m->xcur = xcur;
+    m->ycur = ycur;
+    magnify_owner = q;
+    if (!m->frame_id)
+    {
+        gint64 wait = magnify_last_frame + FRAME_INTERVAL * 1000 - g_get_monotonic_time();
 
-        setup_imlib_for_drawable(m->win);
-        imlib_render_image_part_on_drawable_at_size(xx, yy, m->win_w / m->zoom, m->win_h / m->zoom,
-                                                    0, 0, m->win_w, m->win_h);
-        setup_imlib_for_drawable(q->win);
-        gdk_window_show(m->win);
+        m->frame_id = g_timeout_add(MAX(0, wait / 1000), magnify_frame, m);
+    }
+}
 
-        xx = m->frame_x + xcur - 50 - m->win_w;
-        yy = m->frame_y + ycur - 50 - m->win_h;
-        if (xx < 0)
-        {
-            if (xcur < m->win_w - magnify_img.frame_x)
-                xx = m->frame_x + xcur + 50;
-            else
-                xx = 0;
-        }
-        if (yy < 0)
-        {
-            if (ycur < m->win_h - magnify_img.frame_y)
-                yy = m->frame_y + ycur + 50;
-            else
-                yy = 0;
-        }
-        //    printf("MGL: m->frame_x: %d, m->frame_y: %d, xx: %d, yy: %d\n", m->frame_x,
-        //    m->frame_y, xx, yy);
-        gdk_window_move(m->win, xx, yy);
+void hide_magnify(qiv_image *q, qiv_mgl *m)
+{
+    if (m->frame_id)
+    {
+        g_source_remove(m->frame_id);
+        m->frame_id = 0;
     }
-    gdk_flush();
+    if (m->shown)
+        magnify_restore(q, m, NULL);
+    m->shown = 0;
 }
 
 void center_image(qiv_image *q)
 {
-    q->win_x = (monitor[q->mon_id].width - q->win_w) / 2;
-    q->win_y = (monitor[q->mon_id].height - q->win_h) / 2;
+    gint w = q->win_w, h = q->win_h;
+
+    /* a letterbox window is centered, not the image in it */
+    if (letterbox_w && !fullscreen)
+    {
+        w = letterbox_w;
+        h = letterbox_h;
+    }
+    q->win_x = (monitor[q->mon_id].width - w) / 2;
+    q->win_y = (monitor[q->mon_id].height - h) / 2;
     if (!fullscreen)
     {
         q->win_x += monitor[q->mon_id].x;
@@ -0,0 +1,345 @@
+/*
+  Module       : index.c
+  Purpose      : On-disk index of scanned directories (--cache)
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* $XDG_CACHE_HOME/qiv/index remembers every directory a scan read, by
+ * device and inode, with its modification time and its entries in
+ * readdir order.  For files it also keeps whether the filter found an
+ * image and, after -K, their modification time.  A directory whose
+ * mtime didn't change is taken from the index: one stat() instead of
+ * readdir() and the header checks of the filter.
+ *
+ * Files edited in place don't change the directory, so with -K their
+ * order is updated only once something is added to or removed from
+ * that directory.
+ *
+ * The file is mapped at start and written anew, through a temporary
+ * file next to it, once the list is complete.  Directories not seen this time are
+ * copied over unchanged. */
+
+#define INDEX_MAGIC "QIVIDX01"
+
+typedef struct _index_head
+{
+    guint64 dev, ino;
+    gint64 mtime, mtime_nsec; // of the directory
+    guint32 n; // entries that follow
+    guint32 names; // bytes of names after the entries, padded to 8
+    guint32 followlinks; // symlinks to directories are directories
+    guint32 unused;
+} index_head;
+
+struct _index_rec
+{
+    index_head head;
+    GArray *entries;
+    GArray *paths; // qiv_path of the file entries, 0 for directories
+    GString *names; // names of the directories
+};
+
+static GMappedFile *index_map;
+static GHashTable *old_dirs; // "dev:ino" -> index_head in index_map
+static GPtrArray *new_dirs; // index_rec's read this time
+static GHashTable *new_keys;
+
+/* What the filter and the sort learned about a file, by qiv_path.  Only
+ * scan_collect() grows these, the sort threads just write into them. */
+static guint8 *info_image;
+static gint64 *info_mtime;
+static guint32 info_size;
+
+static char *index_file(const char *suffix)
+{
+    return g_strconcat(g_get_user_cache_dir(), "/qiv/index", suffix, NULL);
+}
+
+static char *dir_key(guint64 dev, guint64 ino)
+{
+    return g_strdup_printf("%" G_GINT64_MODIFIER "x:%" G_GINT64_MODIFIER "x", dev, ino);
+}
+
+static void index_grow(guint32 size)
+{
+    guint32 old = info_size;
+
+    if (size <= info_size)
+        return;
+    info_size = MAX(size, 2 * info_size);
+    info_image = g_renew(guint8, info_image, info_size);
+    info_mtime = g_renew(gint64, info_mtime, info_size);
+    memset(info_image + old, 0, info_size - old);
+    memset(info_mtime + old, 0, (info_size - old) * sizeof *info_mtime);
+}
+
+/* Whether the record at h, len bytes long, can be trusted: names
+ * inside its name block, NUL terminated, and flags in range */
+static int valid_rec(const index_head *h, gsize len)
+{
+    const index_entry *e = (const index_entry *)(h + 1);
+    const char *names = (const char *)(e + h->n);
+    guint32 i;
+
+    if (len % 8 || h->followlinks > 1)
+        return FALSE;
+    for (i = 0; i < h->n; i++, e++)
+    {
+        if (e->name >= h->names || !memchr(names + e->name, 0, h->names - e->name))
+            return FALSE;
+        if (!names[e->name] || strchr(names + e->name, '/'))
+            return FALSE;
+        if (e->is_dir > 1 || e->image > INDEX_OTHER)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Map the index, called before the first scan */
+void index_load(void)
+{
+    char *name = index_file("");
+    const char *p, *end;
+    GError *err = NULL;
+
+    old_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    new_dirs = g_ptr_array_new();
+    new_keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    index_map = g_mapped_file_new(name, FALSE, &err);
+    g_free(name);
+    if (!index_map)
+    {
+        g_error_free(err);
+        return;
+    }
+
+    p = g_mapped_file_get_contents(index_map);
+    end = p + g_mapped_file_get_length(index_map);
+    if (end - p < 8 || memcmp(p, INDEX_MAGIC, 8))
+        return;
+    for (p += 8; p < end;)
+    {
+        const index_head *h = (const index_head *)p;
+        gsize len;
+
+        if (sizeof *h > (gsize)(end - p))
+            break; // truncated
+        len = sizeof *h + (gsize)h->n * sizeof(index_entry) + h->names;
+        if (len > (gsize)(end - p) || !valid_rec(h, len))
+            break;
+        g_hash_table_insert(old_dirs, dir_key(h->dev, h->ino), (gpointer)h);
+        p += len;
+    }
+
+    if (p < end)
+    {
+        /* damaged, better scan everything again */
+        g_print("qiv: ignoring damaged index\n");
+        g_hash_table_remove_all(old_dirs);
+        g_mapped_file_unref(index_map);
+        index_map = NULL;
+    }
+}
+
+/* Entries of the directory sb, if the index has them and they are
+ * current.  Returns their number or -1.  Called by the scan threads. */
+int index_lookup(const struct stat *sb, const index_entry **entries, const char **names)
+{
+    const index_head *h;
+    char *key;
+
+    if (!old_dirs)
+        return -1;
+    key = dir_key(sb->st_dev, sb->st_ino);
+    h = g_hash_table_lookup(old_dirs, key); // read only while scanning
+    g_free(key);
+    if (!h || h->mtime != sb->st_mtime || h->mtime_nsec != sb->st_mtim.tv_nsec ||
+        h->followlinks != (guint32)followlinks)
+        return -1;
+
+    *entries = (const index_entry *)(h + 1);
+    *names = (const char *)(*entries + h->n);
+    return h->n;
+}
+
+/* Start the record of a directory that was just scanned */
+index_rec *index_add_dir(const struct stat *sb)
+{
+    index_rec *r = g_new0(index_rec, 1);
+
+    r->head.dev = sb->st_dev;
+    r->head.ino = sb->st_ino;
+    r->head.mtime = sb->st_mtime;
+    r->head.mtime_nsec = sb->st_mtim.tv_nsec;
+    r->head.followlinks = followlinks;
+    r->entries = g_array_new(FALSE, TRUE, sizeof(index_entry));
+    r->paths = g_array_new(FALSE, FALSE, sizeof(qiv_path));
+    r->names = g_string_new(NULL);
+    g_ptr_array_add(new_dirs, r);
+    return r;
+}
+
+/* ... add a file to it, image and mtime as far as they are known */
+void index_add_file(index_rec *r, qiv_path h, int image, gint64 mtime)
+{
+    index_entry e = {0};
+
+    g_array_append_val(r->entries, e);
+    g_array_append_val(r->paths, h);
+    index_grow(h + 1);
+    info_image[h] = image;
+    info_mtime[h] = mtime;
+}
+
+/* ... or a subdirectory */
+void index_add_subdir(index_rec *r, const char *name)
+{
+    index_entry e = {0};
+    qiv_path none = 0;
+
+    e.is_dir = 1;
+    e.name = r->names->len;
+    g_string_append_len(r->names, name, strlen(name) + 1);
+    g_array_append_val(r->entries, e);
+    g_array_append_val(r->paths, none);
+}
+
+/* INDEX_IMAGE or INDEX_OTHER if the filter looked at h before */
+int index_image(qiv_path h)
+{
+    return h < info_size ? info_image[h] : INDEX_UNCHECKED;
+}
+
+void index_set_image(qiv_path h, int image)
+{
+    if (h < info_size)
+        info_image[h] = image;
+}
+
+/* Modification time of h, FALSE if it isn't known */
+int index_mtime(qiv_path h, time_t *mtime)
+{
+    if (h >= info_size || !info_mtime[h])
+        return FALSE;
+    *mtime = info_mtime[h];
+    return TRUE;
+}
+
+void index_set_mtime(qiv_path h, time_t mtime)
+{
+    if (h < info_size)
+        info_mtime[h] = mtime;
+}
+
+static void write_rec(FILE *f, index_rec *r)
+{
+    static const char pad[8];
+    char buf[PATH_MAX];
+    GString *names = g_string_new(NULL);
+    guint i;
+
+    for (i = 0; i < r->entries->len; i++)
+    {
+        index_entry *e = &g_array_index(r->entries, index_entry, i);
+        qiv_path h = g_array_index(r->paths, qiv_path, i);
+        const char *name;
+
+        if (e->is_dir)
+            name = r->names->str + e->name;
+        else
+        {
+            if (!path_copy(h, buf, sizeof buf))
+                break;
+            name = (name = strrchr(buf, '/')) ? name + 1 : buf;
+            e->image = info_image[h];
+            e->mtime = info_mtime[h];
+        }
+        e->name = names->len;
+        g_string_append_len(names, name, strlen(name) + 1);
+    }
+    if (i < r->entries->len)
+    {
+        /* a name would be cut short, the directory is read again next time */
+        g_string_free(names, TRUE);
+        return;
+    }
+
+    r->head.n = r->entries->len;
+    r->head.names = (names->len + 7) & ~7;
+    fwrite(&r->head, sizeof r->head, 1, f);
+    fwrite(r->entries->data, sizeof(index_entry), r->entries->len, f);
+    fwrite(names->str, 1, names->len, f);
+    fwrite(pad, 1, r->head.names - names->len, f);
+    g_string_free(names, TRUE);
+}
+
+static void write_old(gpointer key, gpointer value, gpointer data)
+{
+    const index_head *h = value;
+
+    if (!g_hash_table_contains(new_keys, key))
+        fwrite(h, sizeof *h + (gsize)h->n * sizeof(index_entry) + h->names, 1, data);
+}
+
+/* Write the index, once filter and sort are done */
+void index_save(void)
+{
+    char *dir, *name, *tmp;
+    FILE *f;
+    guint i;
+    int fd, failed;
+
+    if (!new_dirs || !new_dirs->len)
+        return;
+
+    dir = g_build_filename(g_get_user_cache_dir(), "qiv", NULL);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    name = index_file("");
+    tmp = index_file(".XXXXXX");
+    if ((fd = g_mkstemp(tmp)) < 0 || !(f = fdopen(fd, "wb")))
+    {
+        g_print("qiv: cannot write %s: %s\n", tmp, strerror(errno));
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(tmp);
+        }
+        g_free(name);
+        g_free(tmp);
+        return;
+    }
+
+    fwrite(INDEX_MAGIC, 1, 8, f);
+    for (i = 0; i < new_dirs->len; i++)
+    {
+        index_rec *r = g_ptr_array_index(new_dirs, i);
+
+        g_hash_table_add(new_keys, dir_key(r->head.dev, r->head.ino));
+        write_rec(f, r);
+    }
+    g_hash_table_foreach(old_dirs, write_old, f);
+
+    /* a short write shows in ferror(), a failed flush in fclose() */
+    failed = ferror(f);
+    if (fclose(f) != 0 || failed || rename(tmp, name) < 0)
+    {
+        g_print("qiv: cannot write %s: %s\n", name, strerror(errno));
+        unlink(tmp);
+    }
+    g_free(name);
+    g_free(tmp);
+}
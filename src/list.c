@@ -0,0 +1,346 @@
+/*
+  Module       : list.c
+  Purpose      : Build the image list in the background
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <limits.h>
+#include <string.h>
+
+/* The files and directories from the command line are only collected
+ * while the options are read.  Files named explicitly go into the image
+ * list right away so the first one can be shown immediately; scanning
+ * the directories, filtering and sorting then happen in a thread on a
+ * list of its own.  When that is done the main loop swaps it in and
+ * looks the current image up by path, so the user stays where they are.
+ *
+ * If nothing was named explicitly the first image a scan finds is
+ * handed over early, main() waits only for that one.
+ *
+ * Afterwards watch.c keeps the list up to date with the directories. */
+
+typedef struct _list_source
+{
+    qiv_path path; // file named on the command line or with -F
+    char *dir; // ... or directory to scan, NULL for a file
+    int recursive;
+} list_source;
+
+static GArray *sources;
+static int building; // the thread runs, the list is incomplete
+static int do_shuffle, do_sort;
+static qiv_image *list_img;
+
+static GMutex list_lock;
+static GCond list_cond;
+static qiv_list *built; // finished list, not taken over yet
+static qiv_path first_path; // ... image found early
+static int first_found;
+static gint want_first; // a scan should hand over the next image it finds
+static gint seen; // files found so far
+static GHashTable *removed; // paths deleted while building, main thread only
+
+/* Add a file to the list, it can be shown before the scans are done */
+void list_add_file(const char *name)
+{
+    list_source src = {path_intern(name), NULL, 0};
+
+    if (!sources)
+        sources = g_array_new(FALSE, FALSE, sizeof(list_source));
+    g_array_append_val(sources, src);
+    if (!filter || check_extension(name))
+        image_list_add(src.path);
+}
+
+/* Add the images in directory name to the list */
+void list_add_dir(const char *name, int recursive)
+{
+    list_source src = {0, g_strdup(name), recursive};
+
+    if (!sources)
+        sources = g_array_new(FALSE, FALSE, sizeof(list_source));
+    g_array_append_val(sources, src);
+}
+
+/* Called by the scans for every file they find, in any thread */
+void list_offer(const char *dir, const char *name)
+{
+    if (!g_atomic_int_get(&want_first))
+        return;
+    if (filter && !check_extension(name))
+        return;
+
+    g_mutex_lock(&list_lock);
+    if (g_atomic_int_get(&want_first))
+    {
+        first_path = dir ? path_intern_in(dir, name) : path_intern(name);
+        first_found = 1;
+        g_atomic_int_set(&want_first, 0);
+        g_cond_broadcast(&list_cond);
+    }
+    g_mutex_unlock(&list_lock);
+}
+
+/* ... and count them in batches */
+void list_progress(int files)
+{
+    g_atomic_int_add(&seen, files);
+}
+
+static void shuffle_list(qiv_list *l)
+{
+    qiv_path tmp;
+    int i, p;
+
+    for (i = 0; i < l->n; i++)
+    {
+        p = g_random_int_range(i, l->n);
+        tmp = l->paths[i];
+        l->paths[i] = l->paths[p];
+        l->paths[p] = tmp;
+    }
+}
+
+/* The main thread took h out of the image list, deleted or unloadable.
+ * The list the thread builds mustn't bring it back. */
+void list_removed(qiv_path h)
+{
+    if (!building)
+        return;
+    if (!removed)
+        removed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_add(removed, g_strdup(path_get(h)));
+}
+
+/* ... or put it back, undelete */
+void list_restored(qiv_path h)
+{
+    if (removed)
+        g_hash_table_remove(removed, path_get(h));
+}
+
+static gboolean list_publish(gpointer data);
+
+static gpointer list_build(gpointer data)
+{
+    qiv_list *l = g_new0(qiv_list, 1);
+    guint i;
+
+    if (cache_index)
+        index_load();
+    for (i = 0; i < sources->len; i++)
+    {
+        list_source *src = &g_array_index(sources, list_source, i);
+
+        if (src->dir)
+            rreaddir(src->dir, src->recursive, l);
+        else
+        {
+            list_add(l, src->path);
+            list_progress(1);
+        }
+    }
+
+    if (filter)
+        filter_images(&l->n, l->paths);
+    if (do_shuffle)
+        shuffle_list(l);
+    if (do_sort)
+        sort_images(l->paths, l->n);
+
+    /* before the hand over: once the directories are watched the main
+     * thread scans and filters too, and that touches the index */
+    if (cache_index)
+        index_save();
+
+    g_mutex_lock(&list_lock);
+    built = l;
+    g_cond_broadcast(&list_cond);
+    g_mutex_unlock(&list_lock);
+    if (data)
+        g_idle_add(list_publish, NULL);
+    return NULL;
+}
+
+/* Take over what the thread has, main thread only.  With anchor the
+ * current image keeps its place in the new list.  Returns FALSE if the
+ * current image changed. */
+static int list_take(int anchor)
+{
+    char current[PATH_MAX];
+    qiv_list *l;
+    int i, same = TRUE;
+
+    g_mutex_lock(&list_lock);
+    l = built;
+    built = NULL;
+    if (first_found && !images)
+    {
+        image_list_add(first_path);
+        image_idx = 0;
+        same = FALSE;
+    }
+    first_found = 0;
+    g_mutex_unlock(&list_lock);
+
+    if (!l)
+        return same;
+
+    building = 0;
+    if (removed)
+    {
+        int j = 0;
+
+        for (i = 0; i < l->n; i++)
+            if (!g_hash_table_contains(removed, path_get(l->paths[i])))
+                l->paths[j++] = l->paths[i];
+        l->n = j;
+        g_hash_table_destroy(removed);
+        removed = NULL;
+    }
+    anchor = anchor && images && path_copy(image_list[image_idx], current, sizeof current);
+    image_list_replace(l);
+    watch_start(list_img);
+
+    image_idx = 0;
+    if (!anchor)
+        return FALSE;
+    for (i = 0; i < images; i++)
+        if (path_is(image_list[i], current))
+        {
+            image_idx = i;
+            return same;
+        }
+    return FALSE;
+}
+
+/* The thread is done: swap the list in */
+static gboolean list_publish(gpointer data)
+{
+    qiv_image *q = list_img;
+    int same;
+
+    if (!building)
+        return FALSE; // list_wait() was first
+
+    same = list_take(TRUE);
+    if (!images)
+    {
+        g_print("qiv: cannot load any images.\n");
+        qiv_exit(1);
+    }
+    if (to_root || to_root_t || to_root_s)
+        return FALSE; // the background daemon goes on from image_idx
+
+    if (same)
+        update_image(q, MIN_REDRAW);
+    else
+        qiv_load_image(q);
+    return FALSE;
+}
+
+/* Keep the [i/N] counter running while the thread scans */
+static gboolean list_tick(gpointer data)
+{
+    static int last;
+
+    if (!building)
+        return FALSE;
+    if (list_total() != last)
+    {
+        last = list_total();
+        update_image(list_img, MIN_REDRAW);
+    }
+    return TRUE;
+}
+
+/* Start building the list, in a thread if there are directories to
+ * scan.  With browse the directory of the first file is scanned
+ * instead of what was given. */
+void list_build_start(qiv_image *q, int shuffle, int sort)
+{
+    list_source *src;
+    guint i;
+
+    if (!sources)
+        return;
+    list_img = q;
+    do_shuffle = shuffle;
+    do_sort = sort;
+
+    src = &g_array_index(sources, list_source, 0);
+    if (browse && !src->dir)
+    {
+        const char *name = path_get(src->path);
+        char *anchor = strchr(name, '/') ? g_strdup(name) : g_strconcat("./", name, NULL);
+        char *dir = g_path_get_dirname(anchor);
+        qiv_path h = path_intern(anchor);
+
+        for (i = 0; i < sources->len; i++)
+            g_free(g_array_index(sources, list_source, i).dir);
+        g_array_set_size(sources, 0);
+        list_add_dir(dir, 0);
+
+        images = 0;
+        if (!filter || check_extension(anchor))
+            image_list_add(h);
+        g_free(anchor);
+        g_free(dir);
+    }
+
+    for (i = 0; i < sources->len; i++)
+        if (g_array_index(sources, list_source, i).dir)
+            break;
+    if (i == sources->len)
+    {
+        /* only files, not worth a thread */
+        list_build(NULL);
+        list_take(FALSE);
+        return;
+    }
+
+    building = 1;
+    g_thread_unref(g_thread_new("qiv-list", list_build, GINT_TO_POINTER(1)));
+    if (!to_root && !to_root_t && !to_root_s)
+        g_timeout_add(LIST_PROGRESS_INTERVAL, list_tick, NULL);
+}
+
+/* Block until there is an image to show or the list is complete.
+ * For the start, and when the images found so far didn't load.
+ * Returns the number of images. */
+int list_wait(void)
+{
+    if (!building)
+        return images;
+
+    g_mutex_lock(&list_lock);
+    g_atomic_int_set(&want_first, 1);
+    while (!built && !first_found)
+        g_cond_wait(&list_cond, &list_lock);
+    g_atomic_int_set(&want_first, 0);
+    g_mutex_unlock(&list_lock);
+
+    list_take(browse);
+    return images;
+}
+
+int list_building(void)
+{
+    return building;
+}
+
+/* Whether files that show up later go to their sorted place */
+int list_sorted(void)
+{
+    return do_sort;
+}
+
+/* N for the [i/N] counter, the files found so far while scanning */
+int list_total(void)
+{
+    return building ? MAX(images, g_atomic_int_get(&seen)) : images;
+}
@@ -13,10 +13,6 @@
 
 #include <string.h>
 
-#ifdef HAVE_MAGIC
-#include <magic.h>
-#endif
-
 #include "qiv.h"
 
 #include "main.h"
@@ -24,16 +20,11 @@
 qiv_image main_img;
 qiv_mgl magnify_img; /* [lc] */
 
-static int check_extension(const char *);
 static void qiv_signal_usr1();
 static void qiv_signal_usr2();
 static gboolean qiv_handle_timer(gpointer);
 static void qiv_timer_restart(gpointer);
 
-#ifdef HAVE_MAGIC
-static int check_magic(magic_t cookie, const char *name);
-#endif
-
 int main(int argc, char **argv)
 {
     struct timeval tv;
@@ -140,9 +131,7 @@ int main(int argc, char **argv)
     metricsComment = pango_context_get_metrics(gdk_pango_context_get(), fontdescComment, NULL);
     pango_layout_set_font_description(layoutComment, fontdescComment);
 
-    max_rand_num = images;
-
-    if (!images)
+    if (!images && !list_wait())
     { /* No images to display */
         g_print("qiv: cannot load any images.\n");
         usage(argv[0], 1);
@@ -190,11 +179,6 @@ int main(int argc, char **argv)
 
     qiv_load_image(&main_img);
 
-    if (watch_file)
-    {
-        g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, 100, qiv_watch_file, &main_img, NULL);
-    }
-
     g_main_loop_run(qiv_main_loop); /* will never return */
     return 0;
 }
@@ -259,79 +243,3 @@ static void qiv_timer_restart(gpointer dummy)
 {
     g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, delay, qiv_handle_timer, &slide, qiv_timer_restart);
 }
-
-/* Filter images by extension */
-
-void filter_images(int *images, char **image_names)
-{
-    int i = 0;
-#ifdef HAVE_MAGIC
-    magic_t cookie;
-
-    cookie = magic_open(MAGIC_SYMLINK);
-    magic_load(cookie, NULL);
-#endif
-
-    while (i < *images)
-    {
-        if (check_extension(image_names[i])
-#ifdef HAVE_MAGIC
-            || check_magic(cookie, image_names[i])
-#endif
-        )
-        {
-            i++;
-        }
-        else
-        {
-            int j = i;
-            if (j < *images - 1)
-                image_idx--;
-            while (j < *images - 1)
-            {
-                image_names[j] = image_names[j + 1];
-                ++j;
-            }
-            --(*images);
-        }
-    }
-#ifdef HAVE_MAGIC
-    magic_close(cookie);
-#endif
-    if (image_idx < 0)
-        image_idx = 0;
-}
-
-static int check_extension(const char *name)
-{
-    char *extn = strrchr(name, '.');
-    int i;
-
-    if (extn)
-        for (i = 0; image_extensions[i]; i++)
-            if (strcmp(extn, image_extensions[i]) == 0)
-                return 1;
-
-    return 0;
-}
-
-#ifdef HAVE_MAGIC
-static int check_magic(magic_t cookie, const char *name)
-{
-    const char *description = NULL;
-    int i;
-    int ret = 0;
-
-    description = magic_file(cookie, name);
-    if (description)
-    {
-        for (i = 0; image_magic[i]; i++)
-            if (strcmp(description, image_magic[i]) == 0)
-            {
-                ret = 1;
-                break;
-            }
-    }
-    return ret;
-}
-#endif
@@ -16,10 +16,8 @@ GdkColor text_bg; // statusbar and help background
 GdkColor error_bg; // for the error window/screen
 GdkColor comment_bg; // comment background
 int images; // Number of images in current collection
-char **image_names = NULL; // Filenames of the images
+qiv_path *image_list = NULL; // Filenames of the images, see pathstore.c
 int image_idx = 0; // Index of current image displayed. 0 = 1st image
-int max_image_cnt = 0; //# images currently allocated into arrays
-time_t current_mtime; // modification time of file currently loaded
 qiv_deletedfile *deleted_files;
 int delete_idx;
 char select_dir[FILENAME_LEN];
@@ -55,17 +53,25 @@ int slide; // 1=slide show running
 int scale_down = 1; // resize down if image x/y > screen
 int recursive; // descend recursively
 int followlinks; // follow symlinks to dirs
+int cache_index; // keep an index of scanned directories
+int watch_dirs; // keep the list in step with the directories read
+int follow_new; // jump to files that show up in watched directories
+int mtime_sort; // sort by modification time
+int numeric_sort; // sort numbers in names by value
+int merged_case_sort; // sort AaBb... instead of AB...ab...
+int ignore_path_sort; // sort by file name only
 int to_root; // display on root (centered)
 int to_root_t; // display on root (tiled)
 int to_root_s; // display on root (stretched)
+int root_daemon = 0; // ms between backgrounds when staying resident/off
 int transparency; // transparency on/off
 int do_grab; // grab keboard/pointer (default off)
 int disable_grab; // disable keyboard/mouse grabbing in fullscreen mode
-int max_rand_num; // the largest random number range we will ask for
 int fixed_window_size = 0; // window width fixed size/off
 int fixed_zoom_factor = 0; // window fixed zoom factor (percentage)/off
+int letterbox_w, letterbox_h; // window of fixed size, images centered in it/off
 int zoom_factor = 0; // zoom factor/off
-int watch_file = 0; // watch current files Timestamp, reload if changed
+int watch_file = 0; // reload the current image when it is rewritten
 int magnify = 0; //[lc]
 int user_screen = 0; // preferred (by user) monitor
 int browse = 1; // scan directory of file for browsing
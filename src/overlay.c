@@ -0,0 +1,134 @@
+/*
+  Module       : overlay.c
+  Purpose      : Pre-rendered statusbar, comment and text window boxes
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <string.h>
+
+/* Each overlay box is laid out and rendered into a pixmap once and
+ * kept until its text or font changes.  Redraws only copy the pixmap. */
+
+typedef struct _qiv_overlay
+{
+    GdkPixmap *p;
+    gchar *text; // what p shows
+    const PangoFontDescription *font; // ... and in which font
+    gint w, h; // size of the text, the box is 6 pixels larger
+} qiv_overlay;
+
+static qiv_overlay statusbar_box, comment_box, text_box;
+
+static int overlay_valid(qiv_overlay *o, PangoLayout *l, const char *text)
+{
+    return o->p && o->font == pango_layout_get_font_description(l) && !strcmp(o->text, text);
+}
+
+static void overlay_store(qiv_overlay *o, PangoLayout *l, const char *text, GdkPixmap *p)
+{
+    if (o->p)
+        g_object_unref(o->p);
+    g_free(o->text);
+    o->p = p;
+    o->text = g_strdup(text);
+    o->font = pango_layout_get_font_description(l);
+}
+
+/* Box with a border in the background color, filled with fill_gc,
+ * text at tx/ty */
+static GdkPixmap *box_overlay(qiv_overlay *o, qiv_image *q, PangoLayout *l, const char *text,
+                              GdkGC *fill_gc, gint tx, gint ty)
+{
+    GdkPixmap *p;
+
+    if (overlay_valid(o, l, text))
+        return o->p;
+
+    pango_layout_set_text(l, text, -1);
+    pango_layout_get_pixel_size(l, &o->w, &o->h);
+
+    p = gdk_pixmap_new(q->win, o->w + 6, o->h + 6, -1);
+    gdk_draw_rectangle(p, q->bg_gc, 0, 0, 0, o->w + 5, o->h + 5);
+    gdk_draw_rectangle(p, fill_gc, 1, 1, 1, o->w + 4, o->h + 4);
+    gdk_draw_layout(p, q->text_gc, tx, ty, l);
+    overlay_store(o, l, text, p);
+    return p;
+}
+
+/* The title, sets q->text_w/h */
+GdkPixmap *overlay_statusbar(qiv_image *q)
+{
+    GdkPixmap *p = box_overlay(&statusbar_box, q, layout, q->win_title, q->status_gc, 3, 3);
+
+    q->text_w = statusbar_box.w;
+    q->text_h = statusbar_box.h;
+    return p;
+}
+
+/* The image comment, sets q->comment_w/h */
+GdkPixmap *overlay_comment(qiv_image *q)
+{
+    GdkPixmap *p = box_overlay(&comment_box, q, layoutComment, comment, q->comment_gc, 2, 3);
+
+    q->comment_w = comment_box.w;
+    q->comment_h = comment_box.h;
+    return p;
+}
+
+/* Help, EXIF and command boxes: up to maxlines of strs and a centered
+ * continue_msg below.  *w and *h get the size of the pixmap. */
+GdkPixmap *overlay_text_window(qiv_image *q, const char *strs[], int maxlines,
+                               const char *continue_msg, gint *w, gint *h)
+{
+    int ascent = PANGO_PIXELS(pango_font_metrics_get_ascent(metrics));
+    int descent = PANGO_PIXELS(pango_font_metrics_get_descent(metrics));
+    GString *key = g_string_new(continue_msg);
+    gint *widths, temp, text_w, text_h, i, n;
+    GdkPixmap *p;
+
+    for (n = 0; strs[n] && n < maxlines; n++)
+        g_string_append_printf(key, "\n%s", strs[n]);
+
+    if (!overlay_valid(&text_box, layout, key->str))
+    {
+        /* measure every line once, keep the widths for drawing */
+        widths = g_new(gint, n + 1);
+        pango_layout_set_text(layout, continue_msg, -1);
+        pango_layout_get_pixel_size(layout, &widths[n], NULL);
+        text_w = widths[n];
+        for (i = 0; i < n; i++)
+        {
+            pango_layout_set_text(layout, strs[i], -1);
+            pango_layout_get_pixel_size(layout, &widths[i], NULL);
+            text_w = MAX(text_w, widths[i]);
+        }
+        text_h = (n + 2) * (ascent + descent);
+
+        p = gdk_pixmap_new(q->win, text_w + 8, text_h + 8, -1);
+        gdk_draw_rectangle(p, q->bg_gc, 0, 0, 0, text_w + 7, text_h + 7);
+        gdk_draw_rectangle(p, q->status_gc, 1, 1, 1, text_w + 6, text_h + 6);
+        for (i = 0; i < n; i++)
+        {
+            pango_layout_set_text(layout, strs[i], -1);
+            gdk_draw_layout(p, q->text_gc, 4, 4 + i * (ascent + descent), layout);
+        }
+        pango_layout_set_text(layout, continue_msg, -1);
+        temp = widths[n];
+        gdk_draw_layout(p, q->text_gc, 4 + text_w / 2 - temp / 2,
+                        4 - descent + (n + 1) * (ascent + descent), layout);
+        g_free(widths);
+
+        overlay_store(&text_box, layout, key->str, p);
+        text_box.w = text_w;
+        text_box.h = text_h;
+    }
+    g_string_free(key, TRUE);
+
+    *w = text_box.w + 8;
+    *h = text_box.h + 8;
+    return text_box.p;
+}
@@ -0,0 +1,227 @@
+/*
+  Module       : pathstore.c
+  Purpose      : Compact storage for the file names in the image list
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <limits.h>
+#include <string.h>
+
+/* Every path is split at its last slash.  The directory part goes into
+ * a table and is stored only once, the file names are packed one after
+ * the other into a growing arena.  A qiv_path is the index of a
+ * (directory, name offset) pair, so the image list is a plain array of
+ * 32 bit handles and moving entries around never touches the strings.
+ *
+ * Nothing is ever freed: deleted or renamed files just leave their old
+ * name behind, which is cheap compared to one malloc per file.
+ *
+ * The list is built in a thread while the first image is shown, so the
+ * store is guarded by a read/write lock.  The image list itself belongs
+ * to the main thread. */
+
+#define PATH_RING 8 // path_get() results that stay valid at the same time
+
+typedef struct _path_entry
+{
+    guint32 dir; // index into dirs
+    guint32 name; // offset of the file name in the arena
+} path_entry;
+
+typedef struct _path_dir
+{
+    char *name; // up to and including the last slash, "" for none
+    gsize len;
+} path_dir;
+
+static char *arena;
+static gsize arena_len, arena_size;
+static path_entry *entries;
+static guint32 n_entries, max_entries;
+static path_dir *dirs;
+static guint32 n_dirs, max_dirs;
+static GHashTable *dir_ids; // directory name -> index + 1
+static guint32 last_dir; // files mostly come in directory order
+static GRWLock store_lock;
+
+static int max_images; // size of image_list
+
+/* Index of the directory prefix path[0..len), added if it is new */
+static guint32 intern_dir(const char *path, gsize len)
+{
+    gpointer id;
+    char *name;
+
+    if (n_dirs && dirs[last_dir].len == len && !memcmp(dirs[last_dir].name, path, len))
+        return last_dir;
+
+    if (!dir_ids)
+        dir_ids = g_hash_table_new(g_str_hash, g_str_equal);
+    name = g_strndup(path, len);
+    if ((id = g_hash_table_lookup(dir_ids, name)))
+    {
+        g_free(name);
+        return last_dir = GPOINTER_TO_UINT(id) - 1;
+    }
+
+    if (n_dirs == max_dirs)
+    {
+        max_dirs = max_dirs ? 2 * max_dirs : 256;
+        dirs = g_renew(path_dir, dirs, max_dirs);
+    }
+    dirs[n_dirs].name = name;
+    dirs[n_dirs].len = len;
+    g_hash_table_insert(dir_ids, name, GUINT_TO_POINTER(n_dirs + 1));
+    return last_dir = n_dirs++;
+}
+
+static qiv_path add_entry(guint32 dir, const char *name)
+{
+    gsize len = strlen(name) + 1;
+
+    while (arena_len + len > arena_size)
+    {
+        arena_size = arena_size ? 2 * arena_size : 64 * 1024;
+        arena = g_realloc(arena, arena_size);
+    }
+    memcpy(arena + arena_len, name, len);
+
+    if (n_entries == max_entries)
+    {
+        max_entries = max_entries ? 2 * max_entries : 8192;
+        entries = g_renew(path_entry, entries, max_entries);
+    }
+    entries[n_entries].dir = dir;
+    entries[n_entries].name = arena_len;
+    arena_len += len;
+    return n_entries++;
+}
+
+/* Store a path, returns its handle */
+qiv_path path_intern(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    gsize len = slash ? slash - path + 1 : 0;
+    qiv_path h;
+
+    g_rw_lock_writer_lock(&store_lock);
+    h = add_entry(intern_dir(path, len), path + len);
+    g_rw_lock_writer_unlock(&store_lock);
+    return h;
+}
+
+/* Store name in directory dir, which doesn't end in a slash */
+qiv_path path_intern_in(const char *dir, const char *name)
+{
+    gsize len = strlen(dir);
+    char *prefix;
+    qiv_path h;
+
+    g_rw_lock_writer_lock(&store_lock);
+    /* the common case: same directory as the file before */
+    if (n_dirs && dirs[last_dir].len == len + 1 && dirs[last_dir].name[len] == '/' &&
+        !memcmp(dirs[last_dir].name, dir, len))
+        h = add_entry(last_dir, name);
+    else
+    {
+        prefix = g_strconcat(dir, "/", NULL);
+        h = add_entry(intern_dir(prefix, len + 1), name);
+        g_free(prefix);
+    }
+    g_rw_lock_writer_unlock(&store_lock);
+    return h;
+}
+
+/* Copy the full path of h into buf.  Returns FALSE if it didn't fit
+ * and buf holds only the start of it. */
+int path_copy(qiv_path h, char *buf, gsize size)
+{
+    const path_dir *d;
+    gsize len;
+
+    g_rw_lock_reader_lock(&store_lock);
+    d = &dirs[entries[h].dir];
+    len = g_strlcpy(buf, d->name, size);
+    if (d->len < size)
+        len += g_strlcpy(buf + d->len, arena + entries[h].name, size - d->len);
+    g_rw_lock_reader_unlock(&store_lock);
+    return len < size;
+}
+
+/* Whether h is path, without joining it first */
+int path_is(qiv_path h, const char *path)
+{
+    const path_dir *d;
+    int same;
+
+    g_rw_lock_reader_lock(&store_lock);
+    d = &dirs[entries[h].dir];
+    same = !strncmp(path, d->name, d->len) && !strcmp(path + d->len, arena + entries[h].name);
+    g_rw_lock_reader_unlock(&store_lock);
+    return same;
+}
+
+/* Full path of h in a static buffer.  The last PATH_RING results stay
+ * valid, which is enough to compare two paths or to print a few.
+ * Callers that keep the name across other calls, and threads, use
+ * path_copy(). */
+const char *path_get(qiv_path h)
+{
+    static char ring[PATH_RING][PATH_MAX];
+    static int next;
+    char *buf = ring[next];
+
+    next = (next + 1) % PATH_RING;
+    path_copy(h, buf, PATH_MAX);
+    return buf;
+}
+
+/* Append a path to a list under construction */
+void list_add(qiv_list *l, qiv_path h)
+{
+    if (l->n >= l->size)
+    {
+        l->size = l->size ? 2 * l->size : 8192;
+        l->paths = g_renew(qiv_path, l->paths, l->size);
+    }
+    l->paths[l->n++] = h;
+}
+
+/* Append a path to the image list */
+void image_list_add(qiv_path h)
+{
+    if (images >= max_images)
+    {
+        max_images = max_images ? 2 * max_images : 8192;
+        image_list = g_renew(qiv_path, image_list, max_images);
+    }
+    image_list[images++] = h;
+}
+
+/* Make l the image list, l itself is freed */
+void image_list_replace(qiv_list *l)
+{
+    g_free(image_list);
+    image_list = l->paths;
+    images = l->n;
+    max_images = l->size;
+    g_free(l);
+}
+
+/* Path of image idx, see path_get() */
+const char *image_path(int idx)
+{
+    return path_get(image_list[idx]);
+}
+
+/* Put a path back into the image list at idx */
+void image_list_insert(int idx, qiv_path h)
+{
+    image_list_add(h);
+    memmove(image_list + idx + 1, image_list + idx, (images - 1 - idx) * sizeof *image_list);
+    image_list[idx] = h;
+}
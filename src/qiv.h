@@ -2,6 +2,7 @@
 #include <ctype.h>
 #include <gdk/gdk.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #ifdef SUPPORT_LCMS
@@ -23,6 +24,19 @@
 #define DEFAULT_CONTRAST 256
 #define DEFAULT_GAMMA 256
 #define BUF_LEN 1024
+#define TILE_SIZE 256 // edge of a cached tile of the zoomed image
+#define TILE_CACHE_MAX 256 // number of cached tiles, 64MB at 32bpp
+#define TILE_PREFETCH 2 // rows/columns of tiles prefetched while panning
+#define SCALED_CACHE_MAX (32 * 1024 * 1024) // max pixels of the cached scaled image
+#define REFINE_DELAY 150 // ms of quiet input before a fast preview is re-rendered
+#define FRAME_INTERVAL 16 // ms between frames while dragging or magnifying
+#define MAGNIFY_CACHE 3 // size of the magnifier buffer in lens sizes
+#define SCAN_THREADS 16 // max. threads reading directories with -u
+#define LIST_PROGRESS_INTERVAL 250 // ms between [i/N] updates while scanning
+#define SORT_PARALLEL_MIN 32768 // shorter lists are sorted in one thread
+#define SORT_THREADS 16 // max. threads sorting a large list
+#define FILTER_THREADS 16 // max. threads reading file headers for the filter
+#define WATCH_BATCH_DELAY 100 // ms to collect directory changes before the list is updated
 
 /* FILENAME_LEN is the maximum length of any path/filename that can be
  * handled.  MAX_DELETE determines how many items can be placed into
@@ -44,7 +58,9 @@ typedef struct _qiv_image
     GdkWindow *win; // Main window for windowed and fullscreen mode
     int error; // 1 if Imlib couldn't load image
     gint win_x, win_y, win_w, win_h, mon_id; // window co-ordinates
+    gint wm_x, wm_y, wm_w, wm_h; // geometry last asked of the window manager
     gint orig_w, orig_h; // Size of original image in pixels
+    int view_rot, view_flip; // turns and flips done since loading
     GdkGC *bg_gc; // image window background
     GdkGC *text_gc; // statusbar text color
     GdkGC *status_gc; // statusbar background
@@ -54,8 +70,14 @@ typedef struct _qiv_image
     gint win_ox, win_oy, win_ow, win_oh; // coordinates currently drawn at
     gint text_ow, text_oh; // old size of the statusbar
     int statusbar_was_on; // true if statusbar was visible last frame
+    gint comment_ow, comment_oh; // old size of the comment box
+    int comment_was_on; // true if the comment was visible last frame
+    gchar drawn_title[BUF_LEN]; // title/statusbar text currently shown
+    GdkPixmap *back; // fullscreen frames or the letterbox are composed here
+    GdkRegion *damage; // areas to redraw next frame besides the changes
     int exposed; // window became visible
     int drag; // user is currently dragging the image
+    int tiled; // image is drawn from the tile cache instead of p
     double drag_start_x, drag_start_y; // position of cursor at drag start
     int drag_win_x, drag_win_y; // position of win at drag start
     //  char        infotext[BUF_LEN];
@@ -68,19 +90,46 @@ typedef struct _qiv_mgl
 {
     /* [pw] needs a seperate context? */
     qiv_color_modifier mod; // Image modifier (for brightness..)
-    GdkPixmap *p; // Pixmap of the image to display
-    GdkWindow *win; // window for magnify
-    gint win_x, win_y, win_w, win_h; // window coordinates
-    gint frame_x, frame_y; // UpLeft Corner of frame (titlebar included) of
+    GdkPixmap *p; // pre-scaled neighbourhood of the cursor
+    gint win_x, win_y, win_w, win_h; // lens position and size in the main window
+    gint buf_x, buf_y; // image pixel at the top left of p
+    double buf_zoom; // zoom p was rendered at, 0 if stale
+    gint xcur, ycur; // cursor position to show
+    int shown; // lens is drawn at win_x/win_y
+    guint frame_id; // pending paced redraw
     double zoom;
-    /* main qiv_image */
-    //  GdkGC *bg_gc; //image window background
-    //  int exposed; //window became visible
 } qiv_mgl; /* the magnifying glass [lc] */
 
+typedef guint32 qiv_path; // a file name in the path store
+
+typedef struct _qiv_list
+{
+    qiv_path *paths;
+    int n, size;
+} qiv_list; /* an image list under construction */
+
+enum
+{
+    INDEX_UNCHECKED,
+    INDEX_IMAGE,
+    INDEX_OTHER
+};
+
+typedef struct _index_entry
+{
+    gint64 mtime; // of a file, 0 if it isn't known
+    guint32 name; // offset in the names that follow the entries
+    guint8 is_dir;
+    guint8 image; // INDEX_*, what the filter found
+    guint8 pad[2];
+} index_entry; /* a directory entry in the on-disk index */
+
+typedef struct _index_rec index_rec;
+
 typedef struct _qiv_deletedfile
 {
-    char *filename, *trashfile;
+    qiv_path path;
+    char *trashfile; // NULL if the slot is free
     int pos;
 } qiv_deletedfile;
 
@@ -99,10 +148,8 @@ extern GdkColor text_bg;
 extern GdkColor error_bg;
 extern GdkColor comment_bg;
 extern int images;
-extern char **image_names;
+extern qiv_path *image_list;
 extern int image_idx;
-extern int max_image_cnt;
-extern time_t current_mtime;
 extern qiv_deletedfile *deleted_files;
 extern int delete_idx;
 extern char select_dir[FILENAME_LEN];
@@ -135,15 +182,23 @@ extern int slide;
 extern int scale_down;
 extern int recursive;
 extern int followlinks;
+extern int cache_index;
+extern int watch_dirs;
+extern int follow_new;
+extern int mtime_sort;
+extern int numeric_sort;
+extern int merged_case_sort;
+extern int ignore_path_sort;
 extern int to_root;
 extern int to_root_t;
 extern int to_root_s;
+extern int root_daemon;
 extern int transparency;
 extern int do_grab;
 extern int disable_grab;
-extern int max_rand_num;
 extern int fixed_window_size;
 extern int fixed_zoom_factor;
+extern int letterbox_w, letterbox_h;
 extern int zoom_factor;
 extern int watch_file;
 extern int browse;
@@ -155,6 +210,9 @@ extern int vikeys;
 extern int trashbin;
 
 extern const char *helpstrs[], **helpkeys, *image_extensions[];
+#ifdef HAVE_MAGIC
+extern const char *image_magic[];
+#endif
 
 extern int user_screen;
 
@@ -170,7 +228,6 @@ extern char *get_icc_profile(char *filename);
 
 /* main.c */
 extern void qiv_exit(int);
-extern void filter_images(int *images, char **image_names);
 
 /* image.c */
 
@@ -182,11 +239,25 @@ extern void filter_images(int *images, char **image_names);
 #define MIN_REDRAW 4
 
 extern void qiv_load_image(qiv_image *);
+extern DATA32 *argb_from_pixbuf_loader(const char *image_name, int *has_alpha, int *w, int *h);
+extern void set_loaded_image(qiv_image *q, Imlib_Image im, int has_alpha);
 extern void set_desktop_image(qiv_image *);
+extern GdkPixmap *root_compose(qiv_image *q);
+extern void root_install(GdkPixmap *root_p);
 extern void zoom_in(qiv_image *);
 extern void zoom_out(qiv_image *);
 extern void zoom_maxpect(qiv_image *);
 extern void reload_image(qiv_image *q);
+extern void reshow_image(qiv_image *q);
+extern void rotate_view(qiv_image *q, int quarters);
+extern void flip_view(qiv_image *q, int vertical);
+extern void reset_view(qiv_image *q);
+extern void discard_scaled_image(void);
+extern void install_scaled_image(qiv_image *q, DATA32 *data, gint w, gint h, double elapsed);
+extern void interactive_update(qiv_image *q);
+extern GdkDrawable *overlay_target(qiv_image *q);
+extern void present_overlay(qiv_image *q, gint x, gint y, gint w, gint h);
+extern void expose_image(qiv_image *q, GdkRectangle *area);
 extern void reset_coords(qiv_image *);
 extern void check_size(qiv_image *, gint);
 extern void render_to_pixmap(qiv_image *, double *);
@@ -194,9 +265,96 @@ extern void update_image(qiv_image *, int);
 extern void reset_mod(qiv_image *);
 extern void destroy_image(qiv_image *q);
 extern void center_image(qiv_image *q);
+extern void image_area(qiv_image *q, gint *ox, gint *oy, gint *area_w, gint *area_h);
 extern void correct_image_position(qiv_image *q);
 extern void setup_magnify(qiv_image *, qiv_mgl *); // [lc]
 extern void update_magnify(qiv_image *, qiv_mgl *, int, gint, gint); // [lc]
+extern void hide_magnify(qiv_image *, qiv_mgl *);
+
+/* tiles.c */
+extern int tile_cache_wanted(qiv_image *q);
+extern void tile_cache_invalidate(void);
+extern void tile_cache_set_fast(int fast);
+extern int tile_cache_refine(qiv_image *q);
+extern void tile_cache_draw(qiv_image *q, GdkDrawable *dst, gint dx, gint dy);
+
+/* scale.c */
+extern void scale_job_submit(qiv_image *q, const DATA32 *src, int src_w, int src_h, int dst_w,
+                             int dst_h, int mode);
+extern int scale_job_retarget(int dst_w, int dst_h, int mode);
+extern void scale_nearest(const DATA32 *src, int src_w, int src_h, DATA32 *dst, int dst_w,
+                          int dst_h);
+extern void scale_job_cancel(void);
+extern void scale_level_submit(qiv_image *q, const DATA32 *src, int src_w, int src_h, int levels);
+extern void scale_level_cancel(void);
+
+/* overlay.c */
+extern GdkPixmap *overlay_statusbar(qiv_image *q);
+extern GdkPixmap *overlay_comment(qiv_image *q);
+extern GdkPixmap *overlay_text_window(qiv_image *q, const char *strs[], int maxlines,
+                                      const char *continue_msg, gint *w, gint *h);
+
+/* xshm.c */
+extern DATA32 *xshm_frame(GdkDrawable *d, int w, int h);
+extern Pixmap xshm_upload(GdkDrawable *d);
+
+/* xrender.c */
+extern void xrender_invalidate(void);
+extern void xrender_install_level(qiv_image *q, const DATA32 *data, int w, int h);
+extern int xrender_prepare(qiv_image *q);
+extern Pixmap xrender_render(qiv_image *q, int fast);
+
+/* filter.c */
+extern void filter_images(int *images, qiv_path *list);
+extern int check_extension(const char *name);
+
+/* scan.c */
+extern int rreaddir(const char *dirname, int recursive, qiv_list *out);
+
+/* index.c */
+extern void index_load(void);
+extern int index_lookup(const struct stat *sb, const index_entry **entries, const char **names);
+extern index_rec *index_add_dir(const struct stat *sb);
+extern void index_add_file(index_rec *r, qiv_path h, int image, gint64 mtime);
+extern void index_add_subdir(index_rec *r, const char *name);
+extern int index_image(qiv_path h);
+extern void index_set_image(qiv_path h, int image);
+extern int index_mtime(qiv_path h, time_t *mtime);
+extern void index_set_mtime(qiv_path h, time_t mtime);
+extern void index_save(void);
+
+/* list.c */
+extern void list_add_file(const char *name);
+extern void list_add_dir(const char *name, int recursive);
+extern void list_offer(const char *dir, const char *name);
+extern void list_progress(int files);
+extern void list_build_start(qiv_image *q, int shuffle, int sort);
+extern int list_wait(void);
+extern void list_removed(qiv_path h);
+extern void list_restored(qiv_path h);
+extern int list_building(void);
+extern int list_total(void);
+extern int list_sorted(void);
+
+/* watch.c */
+extern void watch_add_dir(const char *path, int recursive);
+extern void watch_start(qiv_image *q);
+extern void watch_current(qiv_image *q);
+
+/* pathstore.c */
+extern qiv_path path_intern(const char *path);
+extern qiv_path path_intern_in(const char *dir, const char *name);
+extern int path_copy(qiv_path h, char *buf, gsize size);
+extern const char *path_get(qiv_path h);
+extern int path_is(qiv_path h, const char *path);
+extern void list_add(qiv_list *l, qiv_path h);
+extern void image_list_add(qiv_path h);
+extern void image_list_replace(qiv_list *l);
+extern void image_list_insert(int idx, qiv_path h);
+extern const char *image_path(int idx);
+
+/* rootd.c */
+extern void root_daemon_start(qiv_image *q);
 
 /* event.c */
 extern void qiv_handle_event(GdkEvent *, gpointer);
@@ -204,13 +362,17 @@ extern void qiv_handle_event(GdkEvent *, gpointer);
 /* options.c */
 extern void options_read(int, char **, qiv_image *);
 
+/* sort.c */
+extern void sort_images(qiv_path *list, int n);
+extern int sort_position(const qiv_path *list, int n, qiv_path h);
+
 /* utils.c */
 extern int move2trash(void);
 extern int move2trashbin(void);
 extern int copy2select(void);
 extern int undelete_image(void);
 extern void jump2image(char *);
-extern void run_command(qiv_image *, char *, char *, int *, const char ***);
+extern void run_command(qiv_image *, char *, const char *, int *, const char ***);
 extern void finish(int);
 extern void next_image(int);
 extern int checked_atoi(const char *);
@@ -221,12 +383,10 @@ extern gboolean color_alloc(const char *, GdkColor *);
 extern void swap(int *, int *);
 #define myround qiv_round
 extern int myround(double);
-extern gboolean qiv_watch_file(gpointer);
-extern int rreaddir(const char *, int);
 extern int rreadfile(const char *);
-extern int find_image(int images, char **image_names, char *name);
+extern int find_image(const char *name);
 #ifdef HAVE_EXIF
-extern char **get_exif_values(char *filename);
+extern char **get_exif_values(const char *filename);
 #endif
 void dpms_check();
 void dpms_enable();
@@ -0,0 +1,124 @@
+/*
+  Module       : rootd.c
+  Purpose      : Rotate the desktop background (--root-daemon)
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <stdio.h>
+
+/* Instead of exiting after setting the background we stay resident and
+ * step through the image list every root_daemon ms, in the order the
+ * slideshow would use.  Right after a background went up the next image
+ * is decoded in a thread and composed into a root pixmap of its own, so
+ * when the interval is over only the window background is swapped. */
+
+typedef struct _qiv_root_job
+{
+    char *name;
+    DATA32 *data; // decoded image, NULL on error
+    int w, h, has_alpha;
+} qiv_root_job;
+
+static qiv_image *root_img;
+static GdkPixmap *root_next; // next background, composed and waiting
+static int decoding; // a job is in flight
+static int swap_due; // the interval ended before root_next was ready
+static int failed; // images in a row that couldn't be loaded
+
+static void root_daemon_prepare(void);
+
+static void root_swap(void)
+{
+    root_install(root_next);
+    root_next = NULL;
+    swap_due = 0;
+    root_daemon_prepare();
+}
+
+/* Back in the main loop: imlib may be used again, compose the pixmap */
+static gboolean root_decode_done(gpointer data)
+{
+    qiv_root_job *job = data;
+    qiv_image *q = root_img;
+    Imlib_Image im = NULL;
+    int has_alpha = job->has_alpha;
+
+    decoding = 0;
+    if (job->data)
+    {
+        im = imlib_create_image_using_copied_data(job->w, job->h, job->data);
+        free(job->data);
+    }
+    else
+        fprintf(stderr, "qiv: cannot load background image %s\n", job->name);
+    g_free(job->name);
+    g_free(job);
+
+    if (!im)
+    {
+        /* try the one after, unless nothing in the list loads */
+        if (++failed < images)
+            root_daemon_prepare();
+        return FALSE;
+    }
+    failed = 0;
+
+    discard_scaled_image();
+    if (imlib_context_get_image())
+        imlib_free_image();
+    set_loaded_image(q, im, has_alpha);
+    check_size(q, TRUE);
+    root_next = root_compose(q);
+
+    if (swap_due)
+        root_swap();
+    return FALSE;
+}
+
+static gpointer root_decode(gpointer data)
+{
+    qiv_root_job *job = data;
+
+    job->data = argb_from_pixbuf_loader(job->name, &job->has_alpha, &job->w, &job->h);
+    g_idle_add(root_decode_done, job);
+    return NULL;
+}
+
+/* Advance to the next image and start decoding it */
+static void root_daemon_prepare(void)
+{
+    qiv_root_job *job;
+
+    if (decoding || root_next)
+        return;
+
+    next_image(0);
+    job = g_new0(qiv_root_job, 1);
+    job->name = g_strdup(image_path(image_idx));
+    decoding = 1;
+    g_thread_unref(g_thread_new("qiv-rootd", root_decode, job));
+}
+
+static gboolean root_daemon_tick(gpointer data)
+{
+    if (root_next)
+        root_swap();
+    else
+        swap_due = 1;
+    return TRUE;
+}
+
+/* Called once the first background is up */
+void root_daemon_start(qiv_image *q)
+{
+    if (root_img)
+        return;
+
+    root_img = q;
+    g_timeout_add(root_daemon, root_daemon_tick, NULL);
+    root_daemon_prepare();
+}
@@ -0,0 +1,461 @@
+/*
+  Module       : scale.c
+  Purpose      : Scale images in a background thread
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <math.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* Imlib isn't thread safe, so the worker scales the raw ARGB data of
+ * the image itself.  Only one job is run at a time; submitting a new
+ * one cancels the job in flight.  Finished jobs are handed back to the
+ * main loop, which ignores them if they have been superseded.
+ *
+ * The worker also builds the pyramid levels xrender.c uploads.  Those
+ * jobs have a slot of their own, so that scaling for the window and
+ * building a level don't cancel each other; a pending scale job goes
+ * first since its result is what the user waits for. */
+
+typedef struct _qiv_scale_job
+{
+    qiv_image *q;
+    const DATA32 *src;
+    int src_w, src_h;
+    DATA32 *dst;
+    int dst_w, dst_h;
+    int mode; // update_image mode to present the result with
+    int levels; // halvings for a pyramid level, 0 for a scale job
+    guint generation;
+    gint cancel;
+    struct timeval start;
+} qiv_scale_job;
+
+/* contributions of source pixels to one output pixel along an axis */
+typedef struct _qiv_filter
+{
+    int *first, *count;
+    float *weights;
+    int stride; // max. contributions per output pixel
+} qiv_filter;
+
+static GMutex scale_lock;
+static GCond scale_cond;
+static GThread *scale_thread;
+static qiv_scale_job *pending, *pending_level, *running;
+static guint scale_generation, level_generation;
+
+/* Box filter when shrinking (area average), bilinear when enlarging */
+static void filter_setup(qiv_filter *f, int src, int dst)
+{
+    double scale = (double)src / dst;
+    int i, j;
+
+    f->stride = scale > 1.0 ? (int)ceil(scale) + 1 : 2;
+    f->first = malloc(dst * sizeof(int));
+    f->count = malloc(dst * sizeof(int));
+    f->weights = malloc(dst * f->stride * sizeof(float));
+
+    for (i = 0; i < dst; i++)
+    {
+        float *w = f->weights + i * f->stride;
+
+        if (scale > 1.0)
+        {
+            double a = i * scale, b = MIN(src, (i + 1) * scale);
+            int j0 = (int)a, j1 = MIN(src, (int)ceil(b));
+
+            f->first[i] = j0;
+            f->count[i] = j1 - j0;
+            for (j = j0; j < j1; j++)
+                w[j - j0] = (float)((MIN(b, j + 1) - MAX(a, j)) / scale);
+        }
+        else
+        {
+            double x = (i + 0.5) * scale - 0.5;
+            int j0 = (int)floor(x);
+            float frac = (float)(x - j0);
+
+            if (j0 < 0)
+            {
+                j0 = 0;
+                frac = 0;
+            }
+            if (j0 >= src - 1)
+            {
+                j0 = src - 1;
+                frac = 0;
+            }
+            f->first[i] = j0;
+            f->count[i] = frac > 0 ? 2 : 1;
+            w[0] = 1 - frac;
+            w[1] = frac;
+        }
+    }
+}
+
+static void filter_free(qiv_filter *f)
+{
+    free(f->first);
+    free(f->count);
+    free(f->weights);
+}
+
+/* Scale src into dst, separably: each output row accumulates the
+ * horizontally filtered source rows that contribute to it.  Colors are
+ * weighted by alpha while accumulating, so the color of transparent
+ * pixels doesn't bleed into their neighbours, and divided by it again
+ * on output.  Returns 0 if the job was cancelled half way. */
+static int scale_argb(qiv_scale_job *job)
+{
+    qiv_filter fx, fy;
+    float *row = malloc(job->dst_w * 4 * sizeof(float));
+    float *acc = malloc(job->dst_w * 4 * sizeof(float));
+    int x, y, k, j, done = 1;
+
+    filter_setup(&fx, job->src_w, job->dst_w);
+    filter_setup(&fy, job->src_h, job->dst_h);
+
+    for (y = 0; y < job->dst_h; y++)
+    {
+        DATA32 *out = job->dst + (size_t)y * job->dst_w;
+
+        if (g_atomic_int_get(&job->cancel))
+        {
+            done = 0;
+            break;
+        }
+
+        memset(acc, 0, job->dst_w * 4 * sizeof(float));
+        for (j = 0; j < fy.count[y]; j++)
+        {
+            const DATA32 *in = job->src + (size_t)(fy.first[y] + j) * job->src_w;
+            float wy = fy.weights[y * fy.stride + j];
+
+            for (x = 0; x < job->dst_w; x++)
+            {
+                const float *w = fx.weights + x * fx.stride;
+                const DATA32 *p = in + fx.first[x];
+                float a = 0, r = 0, g = 0, b = 0;
+
+                for (k = 0; k < fx.count[x]; k++)
+                {
+                    float wa = w[k] * (p[k] >> 24);
+
+                    a += wa;
+                    r += wa * ((p[k] >> 16) & 0xff);
+                    g += wa * ((p[k] >> 8) & 0xff);
+                    b += wa * (p[k] & 0xff);
+                }
+                row[x * 4 + 0] = a;
+                row[x * 4 + 1] = r;
+                row[x * 4 + 2] = g;
+                row[x * 4 + 3] = b;
+            }
+            for (x = 0; x < job->dst_w * 4; x++)
+                acc[x] += wy * row[x];
+        }
+
+        for (x = 0; x < job->dst_w; x++)
+        {
+            float inv = acc[x * 4 + 0] > 0 ? 1.0f / acc[x * 4 + 0] : 0;
+            DATA32 a = (DATA32)CLAMP(acc[x * 4 + 0] + 0.5f, 0, 255);
+            DATA32 r = (DATA32)CLAMP(acc[x * 4 + 1] * inv + 0.5f, 0, 255);
+            DATA32 g = (DATA32)CLAMP(acc[x * 4 + 2] * inv + 0.5f, 0, 255);
+            DATA32 b = (DATA32)CLAMP(acc[x * 4 + 3] * inv + 0.5f, 0, 255);
+            out[x] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+    }
+
+    filter_free(&fx);
+    filter_free(&fy);
+    free(row);
+    free(acc);
+    return done;
+}
+
+/* Next pyramid level: average 2x2 blocks.  NULL if the job was
+ * cancelled half way. */
+static DATA32 *halve(qiv_scale_job *job, const DATA32 *src, int w, int h, int *nw, int *nh)
+{
+    DATA32 *dst;
+    int x, y, c;
+
+    *nw = w / 2;
+    *nh = h / 2;
+    dst = malloc((size_t)*nw * *nh * sizeof(DATA32));
+
+    for (y = 0; y < *nh; y++)
+    {
+        const DATA32 *a = src + (size_t)(2 * y) * w;
+        const DATA32 *b = a + w;
+        DATA32 *out = dst + (size_t)y * *nw;
+
+        if (g_atomic_int_get(&job->cancel))
+        {
+            free(dst);
+            return NULL;
+        }
+
+        for (x = 0; x < *nw; x++)
+        {
+            DATA32 p = 0;
+
+            for (c = 0; c < 32; c += 8)
+            {
+                DATA32 sum = ((a[2 * x] >> c) & 0xff) + ((a[2 * x + 1] >> c) & 0xff) +
+                             ((b[2 * x] >> c) & 0xff) + ((b[2 * x + 1] >> c) & 0xff);
+                p |= ((sum + 2) / 4) << c;
+            }
+            out[x] = p;
+        }
+    }
+    return dst;
+}
+
+/* Halve src job->levels times.  Returns 0 if the job was cancelled. */
+static int build_level(qiv_scale_job *job)
+{
+    DATA32 *cur = (DATA32 *)job->src, *next;
+    int w = job->src_w, h = job->src_h, i;
+
+    for (i = 0; i < job->levels; i++)
+    {
+        next = halve(job, cur, w, h, &w, &h);
+        if (cur != job->src)
+            free(cur);
+        if (!next)
+            return 0;
+        cur = next;
+    }
+    job->dst = cur;
+    job->dst_w = w;
+    job->dst_h = h;
+    return 1;
+}
+
+/* Nearest neighbour, for previews while the user interacts */
+void scale_nearest(const DATA32 *src, int src_w, int src_h, DATA32 *dst, int dst_w, int dst_h)
+{
+    int *xmap = malloc(dst_w * sizeof(int));
+    int x, y;
+
+    for (x = 0; x < dst_w; x++)
+        xmap[x] = (int)((x + 0.5) * src_w / dst_w);
+
+    for (y = 0; y < dst_h; y++)
+    {
+        const DATA32 *in = src + (size_t)((int)((y + 0.5) * src_h / dst_h)) * src_w;
+        DATA32 *out = dst + (size_t)y * dst_w;
+
+        for (x = 0; x < dst_w; x++)
+            out[x] = in[xmap[x]];
+    }
+    free(xmap);
+}
+
+static void scale_job_free(qiv_scale_job *job)
+{
+    free(job->dst);
+    free(job);
+}
+
+/* Back in the main loop: present the result unless a newer request
+ * or a changed image made it useless. */
+static gboolean scale_job_done(gpointer data)
+{
+    qiv_scale_job *job = data;
+    struct timeval now;
+
+    if (job->generation != (job->levels ? level_generation : scale_generation))
+    {
+        scale_job_free(job);
+        return FALSE;
+    }
+
+    if (job->levels)
+    {
+        /* from now on update_image() scales on the server */
+        xrender_install_level(job->q, job->dst, job->dst_w, job->dst_h);
+        update_image(job->q, job->mode);
+        scale_job_free(job);
+        return FALSE;
+    }
+
+    gettimeofday(&now, 0);
+    install_scaled_image(job->q, job->dst, job->dst_w, job->dst_h,
+                         (now.tv_sec + now.tv_usec / 1.0e6) -
+                             (job->start.tv_sec + job->start.tv_usec / 1.0e6));
+    /* the buffer now belongs to the scaled image */
+    job->dst = NULL;
+    update_image(job->q, job->mode);
+    scale_job_free(job);
+    return FALSE;
+}
+
+static gpointer scale_worker(gpointer data)
+{
+    qiv_scale_job *job;
+    int done;
+
+    g_mutex_lock(&scale_lock);
+    for (;;)
+    {
+        while (!pending && !pending_level)
+            g_cond_wait(&scale_cond, &scale_lock);
+        if (pending)
+        {
+            job = running = pending;
+            pending = NULL;
+        }
+        else
+        {
+            job = running = pending_level;
+            pending_level = NULL;
+        }
+        g_mutex_unlock(&scale_lock);
+
+        done = job->levels ? build_level(job) : scale_argb(job);
+
+        g_mutex_lock(&scale_lock);
+        running = NULL;
+        g_cond_broadcast(&scale_cond);
+        if (done)
+            g_idle_add_full(G_PRIORITY_DEFAULT, scale_job_done, job, NULL);
+        else
+            scale_job_free(job);
+    }
+    return NULL;
+}
+
+/* Scale the ARGB data src of size src_w x src_h to dst_w x dst_h in
+ * the background and call update_image(q, mode) when it's ready.  src
+ * must stay untouched until the job is done or scale_job_cancel()
+ * returned. */
+void scale_job_submit(qiv_image *q, const DATA32 *src, int src_w, int src_h, int dst_w, int dst_h,
+                      int mode)
+{
+    qiv_scale_job *job = calloc(1, sizeof *job);
+
+    job->q = q;
+    job->src = src;
+    job->src_w = src_w;
+    job->src_h = src_h;
+    job->dst_w = dst_w;
+    job->dst_h = dst_h;
+    job->dst = malloc((size_t)dst_w * dst_h * sizeof(DATA32));
+    job->mode = mode;
+    job->generation = ++scale_generation;
+    gettimeofday(&job->start, 0);
+
+    g_mutex_lock(&scale_lock);
+    if (!scale_thread)
+        scale_thread = g_thread_new("qiv-scale", scale_worker, NULL);
+    if (pending)
+        scale_job_free(pending);
+    if (running && !running->levels)
+        g_atomic_int_set(&running->cancel, 1);
+    pending = job;
+    g_cond_broadcast(&scale_cond);
+    g_mutex_unlock(&scale_lock);
+}
+
+/* Halve the ARGB data src of size src_w x src_h levels times in the
+ * background and hand the result to xrender_install_level(), then call
+ * update_image(q, REDRAW).  Nothing is done if that level is already
+ * on its way.  src must stay untouched until the job is done or
+ * scale_level_cancel() returned. */
+void scale_level_submit(qiv_image *q, const DATA32 *src, int src_w, int src_h, int levels)
+{
+    qiv_scale_job *job;
+
+    g_mutex_lock(&scale_lock);
+    job = pending_level ? pending_level : running && running->levels ? running : NULL;
+    if (job && !job->cancel && job->generation == level_generation && job->levels == levels)
+    {
+        g_mutex_unlock(&scale_lock);
+        return;
+    }
+
+    job = calloc(1, sizeof *job);
+    job->q = q;
+    job->src = src;
+    job->src_w = src_w;
+    job->src_h = src_h;
+    job->levels = levels;
+    job->mode = REDRAW;
+    job->generation = ++level_generation;
+    gettimeofday(&job->start, 0);
+
+    if (!scale_thread)
+        scale_thread = g_thread_new("qiv-scale", scale_worker, NULL);
+    if (pending_level)
+        scale_job_free(pending_level);
+    if (running && running->levels)
+        g_atomic_int_set(&running->cancel, 1);
+    pending_level = job;
+    g_cond_broadcast(&scale_cond);
+    g_mutex_unlock(&scale_lock);
+}
+
+/* If the job in flight already produces a dst_w x dst_h image, let it
+ * present with mode as well and return TRUE. */
+int scale_job_retarget(int dst_w, int dst_h, int mode)
+{
+    qiv_scale_job *job;
+    int found = 0;
+
+    g_mutex_lock(&scale_lock);
+    job = pending ? pending : running && !running->levels ? running : NULL;
+    if (job && !job->cancel && job->generation == scale_generation && job->dst_w == dst_w &&
+        job->dst_h == dst_h)
+    {
+        /* FULL_REDRAW > ZOOMED > REDRAW */
+        job->mode = MAX(job->mode, mode);
+        found = 1;
+    }
+    g_mutex_unlock(&scale_lock);
+    return found;
+}
+
+/* Drop all outstanding scale jobs and wait until the worker no longer
+ * reads the source image for them. */
+void scale_job_cancel(void)
+{
+    scale_generation++;
+
+    g_mutex_lock(&scale_lock);
+    if (pending)
+    {
+        scale_job_free(pending);
+        pending = NULL;
+    }
+    if (running && !running->levels)
+        g_atomic_int_set(&running->cancel, 1);
+    while (running && !running->levels)
+        g_cond_wait(&scale_cond, &scale_lock);
+    g_mutex_unlock(&scale_lock);
+}
+
+/* The same for the pyramid level */
+void scale_level_cancel(void)
+{
+    level_generation++;
+
+    g_mutex_lock(&scale_lock);
+    if (pending_level)
+    {
+        scale_job_free(pending_level);
+        pending_level = NULL;
+    }
+    if (running && running->levels)
+        g_atomic_int_set(&running->cancel, 1);
+    while (running && running->levels)
+        g_cond_wait(&scale_cond, &scale_lock);
+    g_mutex_unlock(&scale_lock);
+}
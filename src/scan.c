@@ -0,0 +1,368 @@
+/*
+  Module       : scan.c
+  Purpose      : Read directories, recursively in parallel
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* A recursive scan is spread over a few threads, on a network mount
+ * most of the time goes into waiting for the server.  Every thread
+ * keeps a queue of directories it found; it works on its newest one
+ * and takes the oldest one of another thread when it has nothing left.
+ *
+ * Each directory remembers its entries in readdir order, files and
+ * subdirectories interleaved.  Once all threads are done the tree is
+ * walked depth first, so the list comes out exactly as a plain
+ * recursive walk would have produced it.
+ *
+ * The type of an entry is taken from d_type where the file system fills
+ * it in.  Only unknown entries, and symlinks with --followlinks, are
+ * looked at with fstatat() relative to the open directory.
+ *
+ * With --cache a directory whose mtime matches the index isn't opened
+ * at all, its entries come from there. */
+
+typedef struct _scan_dir scan_dir;
+
+typedef struct _scan_item
+{
+    gsize name; // offset in names
+    scan_dir *dir; // subdirectory, NULL if not scanned
+    guint8 is_dir;
+    guint8 image; // INDEX_*, from the index
+    gint64 mtime; // ... 0 if not known
+} scan_item;
+
+struct _scan_dir
+{
+    char *path;
+    GArray *items;
+    GString *names; // entry names, each ending in a NUL
+    struct stat st; // with --cache, for the index
+    int have_st;
+    int read; // entries are complete, the directory can be watched
+};
+
+typedef struct _scan_worker
+{
+    GMutex lock;
+    GQueue queue; // scan_dir's waiting to be read
+    GThread *thread;
+} scan_worker;
+
+static scan_worker workers[SCAN_THREADS];
+static int nworkers;
+static gint outstanding; // directories queued or being read
+static int queued; // directories in the queues, under idle_lock
+static GMutex idle_lock;
+static GCond idle_cond;
+static GMutex seen_lock;
+static GHashTable *seen; // directories entered with --followlinks
+
+static char *join_path(const char *dir, const char *name)
+{
+    size_t dl = strlen(dir), nl = strlen(name);
+    char *p = malloc(dl + nl + 2);
+
+    memcpy(p, dir, dl);
+    p[dl] = '/';
+    memcpy(p + dl + 1, name, nl + 1);
+    return p;
+}
+
+static scan_dir *scan_dir_new(char *path)
+{
+    scan_dir *d = g_new(scan_dir, 1);
+
+    d->path = path;
+    d->items = g_array_new(FALSE, FALSE, sizeof(scan_item));
+    d->names = g_string_new(NULL);
+    d->have_st = 0;
+    d->read = 0;
+    return d;
+}
+
+static void scan_push(scan_worker *w, scan_dir *d)
+{
+    g_atomic_int_inc(&outstanding);
+    g_mutex_lock(&idle_lock);
+    g_mutex_lock(&w->lock);
+    g_queue_push_tail(&w->queue, d);
+    g_mutex_unlock(&w->lock);
+    queued++;
+    g_cond_signal(&idle_cond);
+    g_mutex_unlock(&idle_lock);
+}
+
+/* Own newest directory first, depth first keeps the queues short */
+static scan_dir *scan_take(scan_worker *w)
+{
+    scan_dir *d;
+    int i;
+
+    g_mutex_lock(&w->lock);
+    d = g_queue_pop_tail(&w->queue);
+    g_mutex_unlock(&w->lock);
+
+    /* steal the oldest, it is likely to have the biggest subtree */
+    for (i = 1; !d && i < nworkers; i++)
+    {
+        scan_worker *v = &workers[(w - workers + i) % nworkers];
+
+        g_mutex_lock(&v->lock);
+        d = g_queue_pop_head(&v->queue);
+        g_mutex_unlock(&v->lock);
+    }
+
+    /* counted in the same idle_lock section that queued it, so the
+     * count can't drop below zero */
+    if (d)
+    {
+        g_mutex_lock(&idle_lock);
+        queued--;
+        g_mutex_unlock(&idle_lock);
+    }
+    return d;
+}
+
+/* With --followlinks a link back up the tree would make us loop */
+static int scan_seen(const struct stat *sb)
+{
+    gchar *key = g_strdup_printf("%lu:%lu", (gulong)sb->st_dev, (gulong)sb->st_ino);
+    int found;
+
+    g_mutex_lock(&seen_lock);
+    found = g_hash_table_contains(seen, key);
+    if (found)
+        g_free(key);
+    else
+        g_hash_table_add(seen, key);
+    g_mutex_unlock(&seen_lock);
+    return found;
+}
+
+static void scan_add(scan_worker *w, scan_dir *d, scan_item *item, const char *name,
+                     int recursive)
+{
+    item->name = d->names->len;
+    item->dir = NULL;
+    g_string_append_len(d->names, name, strlen(name) + 1);
+    if (item->is_dir && recursive)
+    {
+        item->dir = scan_dir_new(join_path(d->path, name));
+        scan_push(w, item->dir);
+    }
+    else if (!item->is_dir)
+        list_offer(d->path, name);
+    g_array_append_val(d->items, *item);
+}
+
+/* Take the entries of d from the index.  Returns FALSE if it has none
+ * or they are out of date. */
+static int scan_cached(scan_worker *w, scan_dir *d, int recursive)
+{
+    const index_entry *entries;
+    const char *names;
+    scan_item item;
+    int i, n, files = 0;
+
+    if (stat(d->path, &d->st) < 0 || (seen && scan_seen(&d->st)))
+        return TRUE;
+    d->have_st = 1;
+    if ((n = index_lookup(&d->st, &entries, &names)) < 0)
+        return FALSE;
+
+    for (i = 0; i < n; i++)
+    {
+        item.is_dir = entries[i].is_dir;
+        item.image = entries[i].image;
+        item.mtime = entries[i].mtime;
+        scan_add(w, d, &item, names + entries[i].name, recursive);
+        files += !item.is_dir;
+    }
+    list_progress(files);
+    d->read = 1;
+    return TRUE;
+}
+
+static void scan_read(scan_worker *w, scan_dir *d, int recursive)
+{
+    struct dirent *entry;
+    struct stat sb;
+    scan_item item = {0};
+    DIR *dir;
+    int fd, files = 0;
+
+    if (cache_index && scan_cached(w, d, recursive))
+        return;
+
+    fd = open(d->path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+    {
+        d->have_st = 0;
+        return;
+    }
+    if (!cache_index && seen && (fstat(fd, &sb) < 0 || scan_seen(&sb)))
+    {
+        close(fd);
+        return;
+    }
+    if (!(dir = fdopendir(fd)))
+    {
+        close(fd);
+        d->have_st = 0;
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+            strcmp(entry->d_name, TRASH_DIR) == 0)
+            continue;
+
+        switch (entry->d_type)
+        {
+        case DT_DIR:
+            item.is_dir = 1;
+            break;
+        case DT_LNK:
+            if (!followlinks)
+            {
+                item.is_dir = 0;
+                break;
+            }
+            /* fall through */
+        case DT_UNKNOWN:
+            if (fstatat(fd, entry->d_name, &sb, followlinks ? 0 : AT_SYMLINK_NOFOLLOW) < 0)
+                continue;
+            item.is_dir = S_ISDIR(sb.st_mode);
+            break;
+        default:
+            item.is_dir = 0;
+        }
+
+        /* the index wants the subdirectories even if we don't */
+        if (item.is_dir && !recursive && !cache_index)
+            continue;
+        scan_add(w, d, &item, entry->d_name, recursive);
+        files += !item.is_dir;
+    }
+    closedir(dir);
+    list_progress(files);
+    d->read = 1;
+}
+
+static gpointer scan_worker_run(gpointer data)
+{
+    scan_worker *w = data;
+    scan_dir *d;
+
+    for (;;)
+    {
+        if ((d = scan_take(w)))
+        {
+            scan_read(w, d, TRUE);
+            if (g_atomic_int_dec_and_test(&outstanding))
+            {
+                g_mutex_lock(&idle_lock);
+                g_cond_broadcast(&idle_cond);
+                g_mutex_unlock(&idle_lock);
+            }
+            continue;
+        }
+
+        /* nothing to do: done, or wait for someone to find more */
+        g_mutex_lock(&idle_lock);
+        while (!queued && g_atomic_int_get(&outstanding))
+            g_cond_wait(&idle_cond, &idle_lock);
+        if (!queued)
+        {
+            g_mutex_unlock(&idle_lock);
+            break;
+        }
+        g_mutex_unlock(&idle_lock);
+    }
+    return NULL;
+}
+
+/* Depth first, in readdir order, freeing the tree on the way */
+static void scan_collect(scan_dir *d, int recursive, qiv_list *out)
+{
+    index_rec *r = d->have_st ? index_add_dir(&d->st) : NULL;
+    guint i;
+
+    for (i = 0; i < d->items->len; i++)
+    {
+        scan_item *item = &g_array_index(d->items, scan_item, i);
+        const char *name = d->names->str + item->name;
+        qiv_path h;
+
+        if (item->is_dir)
+        {
+            if (r)
+                index_add_subdir(r, name);
+            if (item->dir)
+                scan_collect(item->dir, recursive, out);
+            continue;
+        }
+        h = path_intern_in(d->path, name);
+        list_add(out, h);
+        if (r)
+            index_add_file(r, h, item->image, item->mtime);
+    }
+    if (d->read && watch_dirs)
+        watch_add_dir(d->path, recursive);
+    g_array_free(d->items, TRUE);
+    g_string_free(d->names, TRUE);
+    free(d->path);
+    g_free(d);
+}
+
+/* Add the files in dirname, and with recursive in all directories below
+ * it, to out.  Returns the number of files added or -1 if dirname can't
+ * be read. */
+int rreaddir(const char *dirname, int recursive, qiv_list *out)
+{
+    int before_count = out->n;
+    scan_dir *root;
+    int i;
+
+    if (access(dirname, R_OK | X_OK) < 0)
+        return -1;
+
+    root = scan_dir_new(strdup(dirname));
+    if (!recursive)
+    {
+        scan_read(&workers[0], root, FALSE);
+        scan_collect(root, FALSE, out);
+        return out->n - before_count;
+    }
+
+    nworkers = CLAMP(g_get_num_processors() * 2, 1, SCAN_THREADS);
+    if (followlinks)
+        seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    scan_push(&workers[0], root);
+    for (i = 1; i < nworkers; i++)
+        workers[i].thread = g_thread_new("qiv-scan", scan_worker_run, &workers[i]);
+    scan_worker_run(&workers[0]);
+    for (i = 1; i < nworkers; i++)
+        g_thread_join(workers[i].thread);
+
+    if (seen)
+    {
+        g_hash_table_destroy(seen);
+        seen = NULL;
+    }
+
+    scan_collect(root, TRUE, out);
+    return out->n - before_count;
+}
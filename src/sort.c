@@ -0,0 +1,320 @@
+/*
+  Module       : sort.c
+  Purpose      : Sort the image list
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* qsort() calls the compare function n log n times, so everything it
+ * needs is worked out once per file beforehand: the joined path, folded
+ * with casemap for -M, where the suffix and the file name start and,
+ * for -K, the modification time.  That is one stat() per file instead
+ * of two per comparison, none if the --cache index knows it.  Digit
+ * runs for -N are still measured during the compare, it reads those
+ * bytes anyway.
+ *
+ * Large lists are cut into one piece per processor.  Each thread builds
+ * the keys of its piece and sorts them, then the pieces are merged. */
+
+typedef struct _sort_key
+{
+    const unsigned char *name; // path, case folded with -M
+    int suffix; // offset of the last '.', 0 if there is none
+    int base; // offset of the file name
+    time_t mtime;
+    qiv_path path;
+} sort_key;
+
+typedef struct _sort_piece
+{
+    sort_key *keys;
+    const qiv_path *paths;
+    int n;
+    GString *names; // the strings of keys
+    GThread *thread;
+} sort_piece;
+
+/* This array makes it easy to sort filenames into merged-case order
+ * (e.g. AaBbCcDdEeFf...). */
+static unsigned char casemap[256] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F,
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+    0x40, 0x41, 0x43, 0x45, 0x47, 0x49, 0x4B, 0x4D, /* @ABCDEFG */
+    0x4F, 0x51, 0x53, 0x55, 0x57, 0x59, 0x5B, 0x5D, /* HIJKLMNO */
+    0x5F, 0x61, 0x63, 0x65, 0x67, 0x69, 0x6B, 0x6D, /* PQRSTUVW */
+    0x6F, 0x71, 0x73, 0x75, 0x76, 0x77, 0x78, 0x79, /* XYZ[\]^_ */
+    0x7A, 0x42, 0x44, 0x46, 0x48, 0x4A, 0x4C, 0x4E, /* `abcdefg */
+    0x50, 0x52, 0x54, 0x56, 0x58, 0x5A, 0x5C, 0x5E, /* hijklmno */
+    0x60, 0x62, 0x64, 0x66, 0x68, 0x6A, 0x6C, 0x6E, /* pqrstuvw */
+    0x70, 0x72, 0x74, 0x7B, 0x7C, 0x7D, 0x7E, 0x7F, /* xyz{|}~  */
+    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x8B, 0x8C, 0x8D, 0x8E, 0x8F,
+    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D, 0x9E, 0x9F,
+    0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF,
+    0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF,
+    0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF,
+    0xD0, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xDB, 0xDC, 0xDD, 0xDE, 0xDF,
+    0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF,
+    0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF};
+
+/* Fill in k for h, except name: the path, folded for -M, is left in buf.
+ * Returns its length. */
+static int make_key(sort_key *k, qiv_path h, char *buf, gsize size)
+{
+    struct stat attrib;
+    char *slash;
+    int len, j;
+
+    path_copy(h, buf, size);
+    k->path = h;
+    k->mtime = 0;
+    if (mtime_sort && !index_mtime(h, &k->mtime))
+    {
+        k->mtime = stat(buf, &attrib) == 0 ? attrib.st_mtime : 0;
+        index_set_mtime(h, k->mtime);
+    }
+
+    len = strlen(buf);
+    if (merged_case_sort)
+        for (j = 0; j < len; j++)
+            buf[j] = casemap[(unsigned char)buf[j]];
+    for (j = len - 1; j > 0 && buf[j] != '.'; j--)
+    {
+    }
+    k->suffix = MAX(j, 0);
+    k->base = (slash = strrchr(buf, '/')) ? slash - buf + 1 : 0;
+    return len;
+}
+
+static void make_keys(sort_piece *p)
+{
+    char buf[PATH_MAX];
+    gsize *offsets = g_new(gsize, p->n);
+    int i, len;
+
+    p->names = g_string_new(NULL);
+    for (i = 0; i < p->n; i++)
+    {
+        len = make_key(&p->keys[i], p->paths[i], buf, sizeof buf);
+        offsets[i] = p->names->len;
+        g_string_append_len(p->names, buf, len + 1);
+    }
+
+    /* the string may have moved while it grew */
+    for (i = 0; i < p->n; i++)
+        p->keys[i].name = (unsigned char *)p->names->str + offsets[i];
+    g_free(offsets);
+}
+
+/* The old my_strcmp() on precomputed keys.  Names are folded already,
+ * casemap keeps digits, dots and slashes, so plain bytes compare. */
+static int key_cmp(const void *v1, const void *v2)
+{
+    const sort_key *k1 = v1, *k2 = v2;
+    const unsigned char *cp1 = k1->name, *cp2 = k2->name;
+    const unsigned char *sufptr1 = cp1 + k1->suffix, *sufptr2 = cp2 + k2->suffix;
+    int tmp;
+
+    if (mtime_sort)
+    {
+        if (k1->mtime < k2->mtime)
+            return -1;
+        if (k1->mtime > k2->mtime)
+            return 1;
+        // fall through in case of same time stamp
+    }
+
+    if (ignore_path_sort)
+    {
+        cp1 += k1->base;
+        cp2 += k2->base;
+    }
+    if (numeric_sort)
+    {
+        int namelen = 0, diff = 0;
+
+        do
+        {
+            if (sufptr1 && (isdigit(*cp1) || isdigit(*cp2)))
+            {
+                const unsigned char *ep1, *ep2;
+
+                if (diff)
+                    return diff;
+                for (ep1 = cp1; isdigit(*ep1); ep1++)
+                {
+                }
+                if (ep1 == cp1)
+                    return 1;
+                for (ep2 = cp2; isdigit(*ep2); ep2++)
+                {
+                }
+                if (cp2 == ep2)
+                    return -1;
+                if ((diff = (ep1 - cp1) - (ep2 - cp2)) == 0)
+                {
+                    long val = atol((char *)cp1) - atol((char *)cp2);
+                    diff = val < 0 ? -1 : val > 0 ? 1 : 0;
+                }
+                if (diff && sufptr1 - cp1 <= namelen && sufptr2 - cp2 <= namelen)
+                    return diff;
+                namelen += ep1 - cp1;
+                cp1 = ep1;
+                cp2 = ep2 - 1;
+            }
+            else
+            {
+                if (cp1 == sufptr1)
+                {
+                    if (cp2 != sufptr2)
+                        return -1;
+                    sufptr1 = sufptr2 = NULL;
+                }
+                else if (cp2 == sufptr2)
+                    return 1;
+                tmp = *cp1++ - *cp2;
+                if (tmp != 0)
+                    return tmp;
+                if (*cp2 == '/')
+                    namelen = 0;
+                else
+                    namelen++;
+            }
+        } while (*cp2++ != '\0');
+        return diff;
+    }
+
+    do
+    {
+        if (cp1 == sufptr1)
+        {
+            if (cp2 != sufptr2)
+                return -1;
+        }
+        else if (cp2 == sufptr2)
+            return 1;
+        tmp = *cp1++ - *cp2;
+        if (tmp != 0)
+            return tmp;
+    } while (*cp2++ != '\0');
+
+    return 0;
+}
+
+static gpointer sort_piece_run(gpointer data)
+{
+    sort_piece *p = data;
+
+    make_keys(p);
+    qsort(p->keys, p->n, sizeof *p->keys, key_cmp);
+    return NULL;
+}
+
+/* Merge the sorted runs a[0..na) and b[0..nb) into out */
+static void merge(const sort_key *a, int na, const sort_key *b, int nb, sort_key *out)
+{
+    while (na && nb)
+    {
+        if (key_cmp(b, a) < 0)
+        {
+            *out++ = *b++;
+            nb--;
+        }
+        else
+        {
+            *out++ = *a++;
+            na--;
+        }
+    }
+    memcpy(out, a, na * sizeof *a);
+    memcpy(out + na, b, nb * sizeof *b);
+}
+
+/* Sort a list as the options ask for.  Runs in the list thread, and in
+ * the watch thread for files that show up later; with -K both note the
+ * mtimes they stat() in the index.  They never run at the same time. */
+void sort_images(qiv_path *list, int n)
+{
+    sort_key *keys = g_new(sort_key, n), *tmp = NULL, *swap;
+    sort_piece pieces[SORT_THREADS];
+    int npieces = 1, width, i;
+
+    if (n >= SORT_PARALLEL_MIN)
+        npieces = CLAMP(g_get_num_processors(), 1, SORT_THREADS);
+
+    for (i = 0; i < npieces; i++)
+    {
+        pieces[i].keys = keys + (gint64)n * i / npieces;
+        pieces[i].paths = list + (gint64)n * i / npieces;
+        pieces[i].n = (gint64)n * (i + 1) / npieces - (gint64)n * i / npieces;
+    }
+    for (i = 1; i < npieces; i++)
+        pieces[i].thread = g_thread_new("qiv-sort", sort_piece_run, &pieces[i]);
+    sort_piece_run(&pieces[0]);
+    for (i = 1; i < npieces; i++)
+        g_thread_join(pieces[i].thread);
+
+    /* merge neighbouring runs, doubling their length each pass */
+    if (npieces > 1)
+        tmp = g_new(sort_key, n);
+    for (width = 1; width < npieces; width *= 2)
+    {
+        for (i = 0; i < npieces; i += 2 * width)
+        {
+            sort_key *a = pieces[i].keys;
+            int na = 0, nb = 0, j;
+
+            for (j = i; j < i + width && j < npieces; j++)
+                na += pieces[j].n;
+            for (; j < i + 2 * width && j < npieces; j++)
+                nb += pieces[j].n;
+            merge(a, na, a + na, nb, tmp + (a - keys));
+        }
+        swap = keys;
+        keys = tmp;
+        tmp = swap;
+        for (i = 0; i < npieces; i++)
+            pieces[i].keys = keys + (pieces[i].keys - tmp);
+    }
+
+    for (i = 0; i < n; i++)
+        list[i] = keys[i].path;
+
+    for (i = 0; i < npieces; i++)
+        g_string_free(pieces[i].names, TRUE);
+    g_free(keys);
+    g_free(tmp);
+}
+
+/* Where h goes in the sorted list[0..n), after its equals.  For files
+ * that show up later, only log n keys are made.  Main thread, while no
+ * watch thread is sorting. */
+int sort_position(const qiv_path *list, int n, qiv_path h)
+{
+    char buf[PATH_MAX], probe[PATH_MAX];
+    sort_key key, mid;
+    int lo = 0, hi = n, m;
+
+    make_key(&key, h, buf, sizeof buf);
+    key.name = (unsigned char *)buf;
+    while (lo < hi)
+    {
+        m = lo + (hi - lo) / 2;
+        make_key(&mid, list[m], probe, sizeof probe);
+        mid.name = (unsigned char *)probe;
+        if (key_cmp(&mid, &key) <= 0)
+            lo = m + 1;
+        else
+            hi = m;
+    }
+    return lo;
+}
@@ -0,0 +1,235 @@
+/*
+  Module       : tiles.c
+  Purpose      : Tile cache for panning around zoomed images in fullscreen
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <gdk/gdkx.h>
+
+/* When the zoomed image is larger than the monitor we don't render it
+ * into one giant pixmap.  Instead it is cut into TILE_SIZE squares of
+ * the scaled image which are rendered on demand and kept around until
+ * the zoom level or the color modifier changes.  Panning then only
+ * copies tiles to the window. */
+
+typedef struct _qiv_tile
+{
+    GdkPixmap *p; // rendered tile, NULL if the slot is free
+    gint tx, ty; // tile coordinates in the scaled image
+    guint stamp; // time of last use, for LRU eviction
+    int fast; // rendered without anti-aliasing
+} qiv_tile;
+
+static qiv_tile tiles[TILE_CACHE_MAX];
+static guint tile_clock;
+static int tile_fast; // render new tiles without anti-aliasing
+
+static qiv_image *prefetch_img;
+static gint prefetch_dx, prefetch_dy; // direction of the last pan
+static guint prefetch_id;
+
+/* range of tiles covering the visible part of the scaled image */
+static int visible_tiles(qiv_image *q, gint *tx0, gint *ty0, gint *tx1, gint *ty1)
+{
+    gint vx0 = MAX(0, -q->win_x);
+    gint vy0 = MAX(0, -q->win_y);
+    gint vx1 = MIN(q->win_w, monitor[q->mon_id].width - q->win_x);
+    gint vy1 = MIN(q->win_h, monitor[q->mon_id].height - q->win_y);
+
+    if (vx1 <= vx0 || vy1 <= vy0)
+        return 0;
+
+    *tx0 = vx0 / TILE_SIZE;
+    *ty0 = vy0 / TILE_SIZE;
+    *tx1 = (vx1 - 1) / TILE_SIZE;
+    *ty1 = (vy1 - 1) / TILE_SIZE;
+    return 1;
+}
+
+static GdkPixmap *tile_render(qiv_image *q, gint tx, gint ty, int fast)
+{
+    GdkPixmap *p;
+    gint x = tx * TILE_SIZE, y = ty * TILE_SIZE;
+    gint w = MIN(TILE_SIZE, q->win_w - x), h = MIN(TILE_SIZE, q->win_h - y);
+    double fx = (double)q->orig_w / q->win_w, fy = (double)q->orig_h / q->win_h;
+    gint src_x = (gint)(x * fx), src_y = (gint)(y * fy);
+    gint src_w = (gint)((x + w) * fx + 0.5) - src_x;
+    gint src_h = (gint)((y + h) * fy + 0.5) - src_y;
+
+    src_w = CLAMP(src_w, 1, q->orig_w - src_x);
+    src_h = CLAMP(src_h, 1, q->orig_h - src_y);
+
+    p = gdk_pixmap_new(q->win, w, h, -1);
+    imlib_context_set_drawable(GDK_PIXMAP_XID(p));
+    imlib_context_set_anti_alias(!fast);
+    imlib_render_image_part_on_drawable_at_size(src_x, src_y, src_w, src_h, 0, 0, w, h);
+    imlib_context_set_anti_alias(1);
+    imlib_context_set_drawable(GDK_WINDOW_XID(q->win));
+    return p;
+}
+
+static qiv_tile *tile_lookup(gint tx, gint ty)
+{
+    qiv_tile *t;
+
+    for (t = tiles; t < tiles + TILE_CACHE_MAX; t++)
+        if (t->p && t->tx == tx && t->ty == ty)
+            return t;
+    return NULL;
+}
+
+static qiv_tile *tile_get(qiv_image *q, gint tx, gint ty)
+{
+    qiv_tile *t, *victim = tiles;
+
+    if ((t = tile_lookup(tx, ty)))
+    {
+        t->stamp = ++tile_clock;
+        return t;
+    }
+
+    /* take a free slot, otherwise evict the least recently used tile */
+    for (t = tiles; t < tiles + TILE_CACHE_MAX && victim->p; t++)
+        if (!t->p || t->stamp < victim->stamp)
+            victim = t;
+
+    if (victim->p)
+        g_object_unref(victim->p);
+    victim->p = tile_render(q, tx, ty, tile_fast);
+    victim->fast = tile_fast;
+    victim->tx = tx;
+    victim->ty = ty;
+    victim->stamp = ++tile_clock;
+    return victim;
+}
+
+/* Idle handler: render the tiles just outside the viewport in the
+ * direction the user is panning, one tile per call. */
+static gboolean tile_prefetch(gpointer data)
+{
+    qiv_image *q = prefetch_img;
+    gint tx0, ty0, tx1, ty1, tx, ty, d;
+    gint ntx = (q->win_w + TILE_SIZE - 1) / TILE_SIZE;
+    gint nty = (q->win_h + TILE_SIZE - 1) / TILE_SIZE;
+
+    if (!q->tiled || !visible_tiles(q, &tx0, &ty0, &tx1, &ty1))
+        goto done;
+
+    for (d = 1; d <= TILE_PREFETCH; d++)
+    {
+        if (prefetch_dx)
+        {
+            tx = prefetch_dx < 0 ? tx1 + d : tx0 - d;
+            if (tx >= 0 && tx < ntx)
+                for (ty = ty0; ty <= ty1; ty++)
+                    if (!tile_lookup(tx, ty))
+                    {
+                        tile_get(q, tx, ty);
+                        return TRUE;
+                    }
+        }
+        if (prefetch_dy)
+        {
+            ty = prefetch_dy < 0 ? ty1 + d : ty0 - d;
+            if (ty >= 0 && ty < nty)
+                for (tx = tx0; tx <= tx1; tx++)
+                    if (!tile_lookup(tx, ty))
+                    {
+                        tile_get(q, tx, ty);
+                        return TRUE;
+                    }
+        }
+    }
+
+done:
+    prefetch_id = 0;
+    return FALSE;
+}
+
+/* Use tiles if the scaled image doesn't fit on the monitor.  Images
+ * with a transparency mask still go through the whole-image path. */
+int tile_cache_wanted(qiv_image *q)
+{
+    if (!fullscreen || q->error)
+        return 0;
+    if (transparency && imlib_image_has_alpha())
+        return 0;
+    return q->win_w > monitor[q->mon_id].width || q->win_h > monitor[q->mon_id].height;
+}
+
+/* Render new tiles without anti-aliasing while the user interacts */
+void tile_cache_set_fast(int fast)
+{
+    tile_fast = fast;
+}
+
+/* Re-render the visible tiles that were rendered fast.  Returns the
+ * number of tiles that changed. */
+int tile_cache_refine(qiv_image *q)
+{
+    gint tx0, ty0, tx1, ty1;
+    qiv_tile *t;
+    int n = 0;
+
+    if (!visible_tiles(q, &tx0, &ty0, &tx1, &ty1))
+        return 0;
+
+    for (t = tiles; t < tiles + TILE_CACHE_MAX; t++)
+        if (t->p && t->fast && t->tx >= tx0 && t->tx <= tx1 && t->ty >= ty0 && t->ty <= ty1)
+        {
+            g_object_unref(t->p);
+            t->p = tile_render(q, t->tx, t->ty, 0);
+            t->fast = 0;
+            n++;
+        }
+    return n;
+}
+
+void tile_cache_invalidate(void)
+{
+    qiv_tile *t;
+
+    if (prefetch_id)
+    {
+        g_source_remove(prefetch_id);
+        prefetch_id = 0;
+    }
+    for (t = tiles; t < tiles + TILE_CACHE_MAX; t++)
+    {
+        if (t->p)
+            g_object_unref(t->p);
+        t->p = NULL;
+    }
+}
+
+/* Copy the visible tiles to dst.  dx/dy is the distance the image
+ * moved since the last frame and decides where to prefetch. */
+void tile_cache_draw(qiv_image *q, GdkDrawable *dst, gint dx, gint dy)
+{
+    gint tx0, ty0, tx1, ty1, tx, ty;
+    qiv_tile *t;
+
+    if (!visible_tiles(q, &tx0, &ty0, &tx1, &ty1))
+        return;
+
+    for (ty = ty0; ty <= ty1; ty++)
+        for (tx = tx0; tx <= tx1; tx++)
+        {
+            t = tile_get(q, tx, ty);
+            gdk_draw_drawable(dst, q->bg_gc, t->p, 0, 0, q->win_x + tx * TILE_SIZE,
+                              q->win_y + ty * TILE_SIZE, -1, -1);
+        }
+
+    if (dx || dy)
+    {
+        prefetch_img = q;
+        prefetch_dx = dx;
+        prefetch_dy = dy;
+        if (!prefetch_id)
+            prefetch_id = g_idle_add(tile_prefetch, NULL);
+    }
+}
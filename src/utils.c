@@ -36,13 +36,19 @@
 /* move current image to .qiv-trash */
 int move2trash()
 {
-    char *ptr, *ptr2, *filename = image_names[image_idx];
+    char *ptr, *ptr2, filename[PATH_MAX];
     char trashfile[FILENAME_LEN], path_result[PATH_MAX];
     int i;
 
     if (readonly)
         return 0;
 
+    if (!path_copy(image_list[image_idx], filename, sizeof filename))
+    {
+        g_print("*** Error: path too long: '%s'\a\n", filename);
+        return 1;
+    }
+
     if (!(ptr = strrchr(filename, '/')))
     { /* search rightmost slash */
         /* no slash in filename */
@@ -107,16 +113,16 @@ int move2trash()
         del = &deleted_files[delete_idx++];
         if (delete_idx == MAX_DELETE)
             delete_idx = 0;
-        if (del->filename)
-            free(del->trashfile);
-        del->filename = filename;
+        free(del->trashfile);
+        del->path = image_list[image_idx];
         del->trashfile = strdup(trashfile);
         del->pos = image_idx;
 
+        list_removed(image_list[image_idx]);
         --images;
         for (i = image_idx; i < images; ++i)
         {
-            image_names[i] = image_names[i + 1];
+            image_list[i] = image_list[i + 1];
         }
 
         /* If deleting the last file out of x */
@@ -124,7 +130,7 @@ int move2trash()
             image_idx = 0;
 
         /* If deleting the only file left */
-        if (!images)
+        if (!images && !list_wait())
             exit(0);
     }
     return 0;
@@ -138,14 +144,15 @@ int move2trashbin()
     int i;
     int ret = 0;
 
-    del_file = g_file_new_for_path(image_names[image_idx]);
+    del_file = g_file_new_for_path(image_path(image_idx));
 
     if (g_file_trash(del_file, NULL, &del_error))
     {
+        list_removed(image_list[image_idx]);
         --images;
         for (i = image_idx; i < images; ++i)
         {
-            image_names[i] = image_names[i + 1];
+            image_list[i] = image_list[i + 1];
         }
 
         /* If deleting the last file out of x */
@@ -153,7 +160,7 @@ int move2trashbin()
             image_idx = 0;
 
         /* If deleting the only file left */
-        if (!images)
+        if (!images && !list_wait())
             exit(0);
     }
     else
@@ -169,10 +176,17 @@ int move2trashbin()
 /* copy current image to SELECTDIR */
 int copy2select()
 {
-    char *ptr, *filename = image_names[image_idx];
+    const char *ptr;
+    char filename[PATH_MAX];
     char dstfile[FILENAME_LEN], dstfilebak[FILENAME_LEN], tmp[FILENAME_LEN], buf[BUFSIZ];
     int fdi, fdo, n, n2;
 
+    if (!path_copy(image_list[image_idx], filename, sizeof filename))
+    {
+        g_print("*** Error: path too long: '%s'\a\n", filename);
+        return -1;
+    }
+
     /* try to create something; if select_dir doesn't exist, create one */
     snprintf(dstfile, sizeof dstfile, "%s/.qiv-select", select_dir);
     if ((n = open(dstfile, O_CREAT, 0666)) == -1)
@@ -253,6 +267,7 @@ int undelete_image()
 {
     int i;
     qiv_deletedfile *del;
+    const char *filename;
     char *ptr;
 
     if (readonly)
@@ -266,17 +281,18 @@ int undelete_image()
     if (--delete_idx < 0)
         delete_idx = MAX_DELETE - 1;
     del = &deleted_files[delete_idx];
-    if (!del->filename)
+    if (!del->trashfile)
     {
         g_print("Error: nothing to undelete\a\n");
         return 1;
     }
 
-    if (rename(del->trashfile, del->filename) < 0)
+    filename = path_get(del->path);
+    if (rename(del->trashfile, filename) < 0)
     {
-        g_print("Error: undelete_image '%s' failed\a\n", del->filename);
-        del->filename = NULL;
+        g_print("Error: undelete_image '%s' failed\a\n", filename);
         free(del->trashfile);
+        del->trashfile = NULL;
         return 1;
     }
 
@@ -292,14 +308,10 @@ int undelete_image()
     *ptr = '/';
 
     image_idx = del->pos;
-    for (i = images; --i >= image_idx;)
-    {
-        image_names[i + 1] = image_names[i];
-    }
-    images++;
-    image_names[image_idx] = del->filename;
-    del->filename = NULL;
+    image_list_insert(image_idx, del->path);
+    list_restored(del->path);
     free(del->trashfile);
+    del->trashfile = NULL;
 
     return 0;
 }
@@ -308,17 +320,21 @@ int undelete_image()
 #define MAXLINES 100
 
 /* run a command ... */
-void run_command(qiv_image *q, char *n, char *filename, int *numlines, const char ***output)
+void run_command(qiv_image *q, char *n, const char *filename, int *numlines, const char ***output)
 {
     static char nr[100];
     static char *buffer = 0;
     static const char *lines[MAXLINES + 1];
     int pipe_stdout[2];
     int pid;
-    char *newfilename;
+    const char *newfilename;
+    char path[PATH_MAX];
     int i;
     struct stat before, after;
 
+    /* filename may be a path_get() buffer, keep a copy while it runs */
+    g_strlcpy(path, filename, sizeof path);
+    filename = path;
     stat(filename, &before);
 
     if (!buffer)
@@ -399,15 +415,14 @@ void run_command(qiv_image *q, char *n, char *filename, int *numlines, const cha
      * indicating that the filename has changed */
     if (lines[0] && strncmp(lines[0], "NEWNAME=", 8) == 0)
     {
-        newfilename = strdup(lines[0]);
-        newfilename += 8;
+        newfilename = lines[0] + 8;
 #ifdef DEBUG
-        g_print("*** filename has changed from: '%s' to '%s'\n", image_names[image_idx],
+        g_print("*** filename has changed from: '%s' to '%s'\n", image_path(image_idx),
                 newfilename);
 #endif
 
-        image_names[image_idx] = strdup(newfilename);
-        filename = strdup(newfilename);
+        image_list[image_idx] = path_intern(newfilename);
+        path_copy(image_list[image_idx], path, sizeof path);
 
         /* delete this line from the output */
         (*numlines)--;
@@ -560,6 +575,7 @@ void show_help(char *name, int exit_status)
         "    --disable_grab, -G     Disable pointer/kbd grab in fullscreen mode\n"
         "    --fixed_width, -w x    Window with fixed width x\n"
         "    --fixed_zoom, -W x     Window with fixed zoom factor (percentage x)\n"
+        "    --letterbox WxH        One window of W x H pixels, images centered in it\n"
         "    --fullscreen, -f       Use fullscreen window on start-up\n"
         "    --gamma, -g x          Set gamma to x (-32..32)\n"
         "    --help, -h             This help screen\n"
@@ -576,6 +592,7 @@ void show_help(char *name, int exit_status)
         "    --root, -x             Set centered desktop background and exit\n"
         "    --root_t, -y           Set tiled desktop background and exit\n"
         "    --root_s, -z           Set stretched desktop background and exit\n"
+        "    --root-daemon x        Stay resident and change the background every x seconds\n"
         "    --scale_down, -t       Shrink image(s) larger than the screen to fit\n"
         "    --trashbin             Use users trash bin instead of .qiv_trash when deleting\n"
         "                           (undelete key will not work in that case)\n"
@@ -583,6 +600,10 @@ void show_help(char *name, int exit_status)
         "    --watch, -T            Reload the image if it has changed on disk\n"
         "    --recursivedir, -u     Recursively include all files\n"
         "    --followlinks, -L      Follow symlinks to directories (requires --recursivedir)\n"
+        "    --cache                Keep an index of scanned directories in ~/.cache/qiv\n"
+        "    --watch-dirs           Add and remove images as the directories read change\n"
+        "    --follow-new           Jump to new files that show up in the directories\n"
+        "                           (implies --watch-dirs)\n"
         "    --select_dir, -A x     Store the selected files in dir x (default is .qiv-select)\n"
 #if GDK_PIXBUF_MINOR >= 12
         "    --autorotate, -l       Do NOT autorotate JPEGs according to EXIF rotation tag\n"
@@ -634,10 +655,10 @@ int get_random(int replace, int num, int direction)
 
     int n, m, p, q;
 
-    if (!rindices)
-        rindices = (int *)malloc((unsigned)max_rand_num * sizeof(int));
     if (rsize != num)
     {
+        /* the list grows while it is being built */
+        rindices = (int *)realloc(rindices, (unsigned)num * sizeof(int));
         rsize = num;
         index = -1;
     }
@@ -663,60 +684,12 @@ int get_random(int replace, int num, int direction)
     return rindices[index--];
 }
 
-/* Recursively gets all files from a directory if <recursive> is true,
- * else just reads directory */
-int rreaddir(const char *dirname, int recursive)
-{
-    DIR *d;
-    struct dirent *entry;
-    char cdirname[FILENAME_LEN], name[FILENAME_LEN];
-    struct stat sb;
-    int before_count = images;
-
-    strncpy(cdirname, dirname, sizeof cdirname);
-    cdirname[FILENAME_LEN - 1] = '\0';
-
-    if (!(d = opendir(cdirname)))
-        return -1;
-    while ((entry = readdir(d)) != NULL)
-    {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
-            strcmp(entry->d_name, TRASH_DIR) == 0)
-            continue;
-        snprintf(name, sizeof name, "%s/%s", cdirname, entry->d_name);
-        if ((followlinks ? stat(name, &sb) : lstat(name, &sb)) >= 0)
-        {
-            if (S_ISDIR(sb.st_mode))
-            {
-                if (!recursive)
-                    continue;
-                rreaddir(name, 1);
-            }
-            else
-            {
-                if (images >= max_image_cnt)
-                {
-                    max_image_cnt += 8192;
-                    if (!image_names)
-                        image_names = (char **)malloc(max_image_cnt * sizeof(char *));
-                    else
-                        image_names =
-                            (char **)realloc(image_names, max_image_cnt * sizeof(char *));
-                }
-                image_names[images++] = strdup(name);
-            }
-        }
-    }
-    closedir(d);
-    return images - before_count;
-}
-
 /* Read image filenames from a file */
 int rreadfile(const char *filename)
 {
     FILE *fp;
     struct stat sb;
-    int before_count = images;
+    int count = 0;
 
     if (strcmp(filename, "-"))
     {
@@ -727,12 +700,6 @@ int rreadfile(const char *filename)
     else
         fp = stdin;
 
-    if (!images)
-    {
-        max_image_cnt = 8192;
-        image_names = (char **)malloc(max_image_cnt * sizeof(char *));
-    }
-
     while (1)
     {
         char line[BUFSIZ];
@@ -752,18 +719,12 @@ int rreadfile(const char *filename)
             line[linelen--] = '\0';
 
         if (stat(line, &sb) >= 0 && S_ISDIR(sb.st_mode))
-            rreaddir(line, 1);
+            list_add_dir(line, 1);
         else
-        {
-            if (images >= max_image_cnt)
-            {
-                max_image_cnt += 8192;
-                image_names = (char **)realloc(image_names, max_image_cnt * sizeof(char *));
-            }
-            image_names[images++] = strdup(line);
-        }
+            list_add_file(line);
+        count++;
     }
-    return images - before_count;
+    return count;
 }
 
 gboolean color_alloc(const char *name, GdkColor *color)
@@ -803,36 +764,12 @@ int myround(double a)
     return ((a - (int)a > 0.5) ? (int)a + 1 : (int)a);
 }
 
-/* File watcher, an idle thread checking whether the loaded file has changed */
-
-gboolean qiv_watch_file(gpointer data)
-{
-    struct stat statbuf;
-    qiv_image *q = data;
-    if (!watch_file)
-        return FALSE;
-
-    stat(image_names[image_idx], &statbuf);
-
-    if (current_mtime != statbuf.st_mtime && statbuf.st_size)
-    {
-        if (time(NULL) - statbuf.st_mtime > 0)
-        {
-            reload_image(q);
-            check_size(q, FALSE);
-            update_image(q, REDRAW);
-        }
-    }
-
-    return TRUE;
-}
-
-int find_image(int images, char **image_names, char *name)
+int find_image(const char *name)
 {
     int i;
     for (i = 0; i < images; i++)
     {
-        if (strcmp(name, image_names[i]) == 0)
+        if (strcmp(name, image_path(i)) == 0)
             return i;
     }
     return 0;
@@ -1009,7 +946,7 @@ char *get_icc_profile(char *filename)
 #endif
 
 #ifdef HAVE_EXIF
-char **get_exif_values(char *filename)
+char **get_exif_values(const char *filename)
 {
     ExifData *ed;
     ExifEntry *entry;
@@ -0,0 +1,560 @@
+/*
+  Module       : watch.c
+  Purpose      : Follow changes to the scanned directories with inotify
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+/* With --watch-dirs every directory a scan read gets an inotify watch
+ * once the list is complete.  Files that are written and closed or
+ * moved in are added, deleted or moved away ones removed.  New
+ * subdirectories of a -u scan are scanned and watched in turn.
+ *
+ * Events come in bursts, a camera or a render farm writes many files at
+ * once, so they are only collected here.  WATCH_BATCH_DELAY after the
+ * first one the list is updated in one go: a single pass drops what is
+ * gone.  New directories are read and the new files filtered and sorted
+ * among themselves in a thread, then merged in at their sorted place
+ * back in the main loop.  The current image keeps its place.
+ *
+ * If the kernel queue overflows the events are lost, so every watched
+ * directory is read again and compared with the list.  That finds new
+ * and deleted files, not new subdirectories.
+ *
+ * Files that appear between the scan and the start of the watch are not
+ * noticed.
+ *
+ * With --watch the directory of the current image is watched as well,
+ * for the image itself.  Editors and converters often write a new file
+ * and rename it over the old one, which a watch on the file would miss.
+ * The image is reloaded as soon as the writer closes it. */
+
+#define WATCH_DIR_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | \
+                          IN_MOVE_SELF | IN_ONLYDIR)
+#define WATCH_FILE_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR)
+
+#define WATCH_GONE (-1) // in changes, added files have their arrival number
+
+typedef struct _watch_dir
+{
+    char *path;
+    int recursive; // new subdirectories are scanned and watched too
+} watch_dir;
+
+/* The additions of a batch, worked out away from the main loop */
+typedef struct _watch_job
+{
+    GHashTable *new_dirs; // to scan -> arrival number
+    GHashTable *changes; // path -> arrival number or WATCH_GONE
+    qiv_list found; // what the filter let through, sorted if the list is
+    qiv_path follow; // the newest of them
+} watch_job;
+
+static int inotify_fd = -1;
+static GHashTable *dir_watches; // wd -> watch_dir
+static int watch_full; // out of inotify watches
+
+static GMutex pending_lock;
+static GPtrArray *pending; // watch_dir's read by a scan, not watched yet
+
+static qiv_image *watch_img;
+static guint flush_id;
+static GHashTable *changes; // path -> arrival number or WATCH_GONE
+static GPtrArray *gone_dirs; // directories moved away or deleted
+static GHashTable *new_dirs; // ... and new ones to scan -> arrival number
+static int arrivals; // for --follow-new, counts the additions
+static int adding; // a watch_job is in flight
+static int overflow; // events were lost, read all directories again
+static GHashTable *present; // ... the files found then
+static GHashTable *present_dirs; // ... in these directories
+
+static qiv_image *file_img;
+static int file_wd = -1; // directory of the current image with --watch
+static char *file_name; // ... and its name in there
+static int file_changed;
+
+static void watch_dir_free(gpointer data)
+{
+    watch_dir *w = data;
+
+    g_free(w->path);
+    g_free(w);
+}
+
+static gboolean watch_flush(gpointer data);
+
+/* Whether path is the select_dir 'a' copies images to.  It is left
+ * alone like TRASH_DIR, the copies are no new images. */
+static int is_select_dir(const char *path)
+{
+    struct stat a, b;
+
+    return stat(path, &a) == 0 && stat(select_dir, &b) == 0 && a.st_dev == b.st_dev &&
+           a.st_ino == b.st_ino;
+}
+
+static void watch_file_event(watch_dir *w, const struct inotify_event *ev)
+{
+    char *path = g_strconcat(w->path, "/", ev->name, NULL);
+
+    if (ev->mask & IN_ISDIR)
+    {
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+        {
+            if (w->recursive && !is_select_dir(path))
+                g_hash_table_insert(new_dirs, path, GINT_TO_POINTER(++arrivals));
+            else
+                g_free(path);
+        }
+        else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+            g_ptr_array_add(gone_dirs, path);
+        else
+            g_free(path);
+        return;
+    }
+
+    if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+        g_hash_table_insert(changes, path, GINT_TO_POINTER(++arrivals));
+    else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+        g_hash_table_insert(changes, path, GINT_TO_POINTER(WATCH_GONE));
+    else
+        g_free(path); // IN_CREATE of a file, wait until it is written
+}
+
+static void watch_event(const struct inotify_event *ev)
+{
+    watch_dir *w = g_hash_table_lookup(dir_watches, GINT_TO_POINTER(ev->wd));
+
+    if (ev->mask & IN_Q_OVERFLOW)
+    {
+        overflow = 1;
+        return;
+    }
+    if (ev->wd == file_wd)
+    {
+        if (ev->mask & IN_IGNORED)
+            file_wd = -1;
+        else if (ev->len && (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) &&
+                 !strcmp(ev->name, file_name))
+            file_changed = 1;
+    }
+    if (!w)
+        return;
+    if (ev->mask & IN_IGNORED)
+    {
+        g_hash_table_remove(dir_watches, GINT_TO_POINTER(ev->wd));
+        return;
+    }
+    if (ev->mask & IN_MOVE_SELF)
+    {
+        /* its files are somewhere else now */
+        g_ptr_array_add(gone_dirs, g_strdup(w->path));
+        inotify_rm_watch(inotify_fd, ev->wd);
+        return;
+    }
+    if (ev->len && strcmp(ev->name, TRASH_DIR) != 0)
+        watch_file_event(w, ev);
+}
+
+static gboolean watch_read(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    union
+    {
+        struct inotify_event ev;
+        char bytes[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+    } buf;
+    const struct inotify_event *ev;
+    ssize_t len;
+    char *p;
+
+    while ((len = read(inotify_fd, buf.bytes, sizeof buf.bytes)) > 0)
+        for (p = buf.bytes; p < buf.bytes + len; p += sizeof *ev + ev->len)
+        {
+            ev = (const struct inotify_event *)p;
+            watch_event(ev);
+        }
+
+    if (!flush_id && (g_hash_table_size(changes) || gone_dirs->len || g_hash_table_size(new_dirs) ||
+                      overflow))
+        flush_id = g_timeout_add(WATCH_BATCH_DELAY, watch_flush, NULL);
+
+    if (file_changed && watch_file)
+    {
+        reload_image(file_img);
+        check_size(file_img, FALSE);
+        update_image(file_img, REDRAW);
+    }
+    file_changed = 0;
+    return TRUE;
+}
+
+/* The inotify descriptor, set up on first use */
+static int watch_fd(void)
+{
+    GIOChannel *channel;
+
+    if (inotify_fd >= 0)
+        return inotify_fd;
+    if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+        return -1;
+
+    dir_watches = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, watch_dir_free);
+    changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    gone_dirs = g_ptr_array_new_with_free_func(g_free);
+    new_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    channel = g_io_channel_unix_new(inotify_fd);
+    g_io_add_watch(channel, G_IO_IN, watch_read, NULL);
+    g_io_channel_unref(channel);
+    return inotify_fd;
+}
+
+/* Remember a directory a scan has read, in any thread */
+void watch_add_dir(const char *path, int recursive)
+{
+    watch_dir *w = g_new(watch_dir, 1);
+
+    w->path = g_strdup(path);
+    w->recursive = recursive;
+    g_mutex_lock(&pending_lock);
+    if (!pending)
+        pending = g_ptr_array_new();
+    g_ptr_array_add(pending, w);
+    g_mutex_unlock(&pending_lock);
+}
+
+/* Watch the directories read so far, main thread only */
+void watch_start(qiv_image *q)
+{
+    GPtrArray *dirs;
+    watch_dir *w;
+    guint i;
+    int wd;
+
+    g_mutex_lock(&pending_lock);
+    dirs = pending;
+    pending = NULL;
+    g_mutex_unlock(&pending_lock);
+    if (!dirs)
+        return;
+
+    watch_img = q;
+    for (i = 0; i < dirs->len; i++)
+    {
+        w = g_ptr_array_index(dirs, i);
+        if (to_root || to_root_t || to_root_s || watch_full || watch_fd() < 0 ||
+            is_select_dir(w->path))
+        {
+            watch_dir_free(w);
+            continue;
+        }
+
+        wd = inotify_add_watch(inotify_fd, w->path, WATCH_DIR_EVENTS);
+        if (wd < 0)
+        {
+            if (errno == ENOSPC)
+            {
+                g_print("qiv: out of inotify watches, not all directories are followed "
+                        "(see /proc/sys/fs/inotify/max_user_watches)\n");
+                watch_full = 1;
+            }
+            watch_dir_free(w);
+        }
+        else if (g_hash_table_contains(dir_watches, GINT_TO_POINTER(wd)))
+            watch_dir_free(w); // same directory by another path
+        else
+            g_hash_table_insert(dir_watches, GINT_TO_POINTER(wd), w);
+    }
+    g_ptr_array_free(dirs, TRUE);
+}
+
+/* Watch the current image for changes with --watch, or stop that.
+ * Called whenever another image is loaded. */
+void watch_current(qiv_image *q)
+{
+    const char *path = image_path(image_idx);
+    char *dir;
+    int wd = -1;
+
+    file_img = q;
+    g_free(file_name);
+    file_name = NULL;
+    if (watch_file && images && watch_fd() >= 0)
+    {
+        dir = g_path_get_dirname(path);
+        /* the directory may be watched for the list already, keep that */
+        wd = inotify_add_watch(inotify_fd, dir, WATCH_FILE_EVENTS | IN_MASK_ADD);
+        g_free(dir);
+        file_name = g_path_get_basename(path);
+    }
+
+    if (file_wd >= 0 && file_wd != wd &&
+        !g_hash_table_contains(dir_watches, GINT_TO_POINTER(file_wd)))
+        inotify_rm_watch(inotify_fd, file_wd);
+    file_wd = wd;
+}
+
+/* Stop watching directories below a gone one, their paths are stale */
+static void watch_below(gpointer key, gpointer value, gpointer data)
+{
+    watch_dir *w = value;
+    gsize len = strlen(data);
+
+    if (!strncmp(w->path, data, len) && w->path[len] == '/')
+        inotify_rm_watch(inotify_fd, GPOINTER_TO_INT(key));
+}
+
+/* After an overflow: the file is in a directory that was read again,
+ * but wasn't found there */
+static int not_present(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    char *dir;
+    int watched;
+
+    if (!present || !slash || g_hash_table_contains(present, path))
+        return FALSE;
+    dir = g_strndup(path, slash - path);
+    watched = g_hash_table_contains(present_dirs, dir);
+    g_free(dir);
+    return watched;
+}
+
+/* Read all watched directories again, new files go into changes */
+static void watch_resync(void)
+{
+    qiv_list found = {NULL, 0, 0};
+    GHashTableIter iter;
+    gpointer key, value;
+    int i;
+
+    g_print("qiv: too many changes at once, reading the directories again\n");
+    present = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    present_dirs = g_hash_table_new(g_str_hash, g_str_equal);
+
+    g_hash_table_iter_init(&iter, dir_watches);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        watch_dir *w = value;
+
+        g_hash_table_add(present_dirs, w->path);
+        rreaddir(w->path, FALSE, &found);
+    }
+    for (i = 0; i < found.n; i++)
+    {
+        const char *name = path_get(found.paths[i]);
+
+        g_hash_table_add(present, g_strdup(name));
+        if (!g_hash_table_contains(changes, name))
+            g_hash_table_insert(changes, g_strdup(name), GINT_TO_POINTER(++arrivals));
+    }
+    g_free(found.paths);
+}
+
+static int in_gone_dir(const char *path)
+{
+    guint i;
+
+    for (i = 0; i < gone_dirs->len; i++)
+    {
+        const char *dir = g_ptr_array_index(gone_dirs, i);
+        gsize len = strlen(dir);
+
+        if (!strncmp(path, dir, len) && path[len] == '/')
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Merge the sorted add[0..n) into the sorted image list */
+static void merge_sorted(qiv_path *add, int n)
+{
+    qiv_list *l = g_new0(qiv_list, 1);
+    int k, pos, from = 0, before = 0;
+
+    for (k = 0; k < n; k++)
+    {
+        pos = sort_position(image_list, images, add[k]);
+        before += pos <= image_idx;
+        for (; from < pos; from++)
+            list_add(l, image_list[from]);
+        list_add(l, add[k]);
+    }
+    for (; from < images; from++)
+        list_add(l, image_list[from]);
+    image_list_replace(l);
+    image_idx += before;
+}
+
+/* Back in the main loop: put the new files into the list */
+static gboolean watch_add_done(gpointer data)
+{
+    watch_job *job = data;
+    int i;
+
+    adding = 0;
+    watch_start(watch_img);
+
+    if (job->found.n)
+    {
+        if (list_sorted())
+            merge_sorted(job->found.paths, job->found.n);
+        else
+            for (i = 0; i < job->found.n; i++)
+                image_list_add(job->found.paths[i]);
+
+        for (i = 0; follow_new && i < images && image_list[i] != job->follow; i++)
+        {
+        }
+        if (follow_new && i < images && i != image_idx)
+        {
+            image_idx = i;
+            qiv_load_image(watch_img);
+        }
+        else
+            update_image(watch_img, MIN_REDRAW);
+    }
+
+    g_hash_table_destroy(job->new_dirs);
+    g_hash_table_destroy(job->changes);
+    g_free(job->found.paths);
+    g_free(job);
+    return FALSE;
+}
+
+/* Read the new directories, filter and sort the new files */
+static gpointer watch_add_run(gpointer data)
+{
+    watch_job *job = data;
+    GHashTable *arrival = g_hash_table_new(g_direct_hash, g_direct_equal); // qiv_path -> number
+    GHashTableIter iter;
+    gpointer key, value;
+    int i, n, last = 0;
+
+    g_hash_table_iter_init(&iter, job->new_dirs);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        n = job->found.n;
+        rreaddir(key, TRUE, &job->found);
+        for (; n < job->found.n; n++)
+            g_hash_table_insert(arrival, GUINT_TO_POINTER(job->found.paths[n]), value);
+    }
+
+    g_hash_table_iter_init(&iter, job->changes);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        if (GPOINTER_TO_INT(value) > 0)
+        {
+            qiv_path h = path_intern(key);
+
+            list_add(&job->found, h);
+            g_hash_table_insert(arrival, GUINT_TO_POINTER(h), value);
+        }
+
+    /* the newest of what is left after the filter, the last of a new
+     * directory in readdir order */
+    if (filter)
+        filter_images(&job->found.n, job->found.paths);
+    for (i = 0; i < job->found.n; i++)
+    {
+        n = GPOINTER_TO_INT(g_hash_table_lookup(arrival, GUINT_TO_POINTER(job->found.paths[i])));
+        if (n >= last)
+        {
+            last = n;
+            job->follow = job->found.paths[i];
+        }
+    }
+    g_hash_table_destroy(arrival);
+
+    if (job->found.n && list_sorted())
+        sort_images(job->found.paths, job->found.n);
+    g_idle_add(watch_add_done, job);
+    return NULL;
+}
+
+static gboolean watch_flush(gpointer data)
+{
+    qiv_path current = image_list[image_idx];
+    GHashTableIter iter;
+    gpointer value;
+    watch_job *job;
+    int i, j, idx = 0, current_gone = FALSE, changed, added = FALSE;
+    guint k;
+
+    /* wait for the files of the last batch, they may be rewritten already */
+    if (adding)
+        return TRUE;
+
+    flush_id = 0;
+    if (overflow)
+        watch_resync();
+
+    /* drop what is gone, and note what is there already */
+    for (k = 0; k < gone_dirs->len; k++)
+        g_hash_table_foreach(dir_watches, watch_below, g_ptr_array_index(gone_dirs, k));
+    for (i = j = 0; i < images; i++)
+    {
+        const char *name = image_path(i);
+        int state = GPOINTER_TO_INT(g_hash_table_lookup(changes, name));
+
+        if (i == image_idx)
+            idx = j; // where it, or the one after it, ends up
+        if (state > 0)
+            g_hash_table_remove(changes, name); // rewritten, not new
+        else if (state == WATCH_GONE || in_gone_dir(name) || not_present(name))
+        {
+            current_gone |= i == image_idx;
+            continue;
+        }
+        image_list[j++] = image_list[i];
+    }
+    if (!j)
+    {
+        /* keep something to show */
+        image_list[j++] = current;
+        current_gone = FALSE;
+    }
+    changed = j != images;
+    images = j;
+    image_idx = MIN(idx, images - 1);
+
+    g_hash_table_iter_init(&iter, changes);
+    while (!added && g_hash_table_iter_next(&iter, NULL, &value))
+        added = GPOINTER_TO_INT(value) > 0;
+    if (added || g_hash_table_size(new_dirs))
+    {
+        /* the tables go to the thread, start new ones */
+        job = g_new0(watch_job, 1);
+        job->new_dirs = new_dirs;
+        job->changes = changes;
+        new_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        adding = 1;
+        g_thread_unref(g_thread_new("qiv-watch", watch_add_run, job));
+    }
+    else
+        g_hash_table_remove_all(changes);
+
+    g_ptr_array_set_size(gone_dirs, 0);
+    if (overflow)
+    {
+        g_hash_table_destroy(present);
+        g_hash_table_destroy(present_dirs);
+        present = present_dirs = NULL;
+        overflow = 0;
+    }
+
+    if (current_gone)
+        qiv_load_image(watch_img);
+    else if (changed)
+        update_image(watch_img, MIN_REDRAW);
+    return FALSE;
+}
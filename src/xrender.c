@@ -0,0 +1,177 @@
+/*
+  Module       : xrender.c
+  Purpose      : Scale images on the X server with the RENDER extension
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <gdk/gdkx.h>
+
+#ifdef HAVE_XRENDER
+#include <X11/extensions/Xrender.h>
+
+/* The image is uploaded once into a server side Picture, either at
+ * full size or as the smallest level of a halving pyramid that is
+ * still at least as big as the window.  Zooming then only sets a new
+ * transform and composites, no pixels go over the wire.  Images that
+ * need a color modifier or a transparency mask take the imlib path.
+ *
+ * Levels below full size are built by the scale worker.  Until one is
+ * uploaded update_image() scales on the client like it does without
+ * RENDER; once it arrives the next frames are composited here. */
+
+static int render_state; // 0 not checked yet, 1 usable, -1 not available
+static Display *level_dpy;
+static Pixmap level_pix = None;
+static Picture level_pic = None;
+static int level_w, level_h;
+
+static int xrender_usable(GdkDrawable *d)
+{
+    Display *dpy = gdk_x11_drawable_get_xdisplay(d);
+    Visual *vis = gdk_x11_visual_get_xvisual(gdk_drawable_get_visual(d));
+    int event_base, error_base;
+
+    if (!render_state)
+        render_state = XRenderQueryExtension(dpy, &event_base, &error_base) &&
+                               XRenderFindVisualFormat(dpy, vis)
+                           ? 1
+                           : -1;
+    return render_state > 0;
+}
+
+static void upload_level(GdkDrawable *d, const DATA32 *data, int w, int h)
+{
+    Display *dpy = gdk_x11_drawable_get_xdisplay(d);
+    Visual *vis = gdk_x11_visual_get_xvisual(gdk_drawable_get_visual(d));
+    XImage *xi;
+    GC gc;
+    union {
+        guint32 i;
+        char c[4];
+    } order = {1};
+
+    level_dpy = dpy;
+    level_w = w;
+    level_h = h;
+    level_pix = XCreatePixmap(dpy, gdk_x11_drawable_get_xid(d), w, h, 24);
+
+    xi = XCreateImage(dpy, vis, 24, ZPixmap, 0, (char *)data, w, h, 32, w * 4);
+    xi->byte_order = order.c[0] ? LSBFirst : MSBFirst;
+    gc = XCreateGC(dpy, level_pix, 0, NULL);
+    XPutImage(dpy, level_pix, gc, xi, 0, 0, 0, 0, w, h);
+    XFreeGC(dpy, gc);
+    xi->data = NULL; // not ours to free
+    XDestroyImage(xi);
+
+    level_pic = XRenderCreatePicture(dpy, level_pix,
+                                     XRenderFindStandardFormat(dpy, PictStandardRGB24), 0, NULL);
+}
+
+static void free_level(void)
+{
+    if (level_pic)
+    {
+        XRenderFreePicture(level_dpy, level_pic);
+        XFreePixmap(level_dpy, level_pix);
+        level_pic = None;
+        level_pix = None;
+    }
+}
+
+/* Forget the uploaded image, it changed */
+void xrender_invalidate(void)
+{
+    scale_level_cancel();
+    free_level();
+}
+
+/* Upload a level the scale worker built for the current image */
+void xrender_install_level(qiv_image *q, const DATA32 *data, int w, int h)
+{
+    free_level();
+    upload_level(q->win, data, w, h);
+}
+
+/* Check whether the current image can be scaled on the server with
+ * the pyramid level that fits the zoom.  If that level isn't uploaded
+ * yet it is handed to the scale worker and 0 returned. */
+int xrender_prepare(qiv_image *q)
+{
+    int w = q->orig_w, h = q->orig_h, levels = 0;
+
+    if (!xrender_usable(q->win))
+        return 0;
+    if (imlib_context_get_color_modifier() || (transparency && imlib_image_has_alpha()))
+        return 0;
+    if ((double)q->win_w * q->win_h > SCALED_CACHE_MAX)
+        return 0;
+
+    while (w / 2 >= q->win_w && h / 2 >= q->win_h)
+    {
+        w /= 2;
+        h /= 2;
+        levels++;
+    }
+    if ((double)w * h > SCALED_CACHE_MAX || w > 32767 || h > 32767)
+        return 0;
+    if (level_pic && level_w == w && level_h == h)
+        return 1;
+
+    if (levels)
+    {
+        scale_level_submit(q, imlib_image_get_data_for_reading_only(), q->orig_w, q->orig_h,
+                           levels);
+        return 0;
+    }
+
+    free_level();
+    upload_level(q->win, imlib_image_get_data_for_reading_only(), w, h);
+    return 1;
+}
+
+/* Composite the uploaded level into a new window sized pixmap */
+Pixmap xrender_render(qiv_image *q, int fast)
+{
+    Display *dpy = level_dpy;
+    Visual *vis = gdk_x11_visual_get_xvisual(gdk_drawable_get_visual(q->win));
+    Pixmap p = XCreatePixmap(dpy, gdk_x11_drawable_get_xid(q->win), q->win_w, q->win_h,
+                             gdk_drawable_get_depth(q->win));
+    Picture dst = XRenderCreatePicture(dpy, p, XRenderFindVisualFormat(dpy, vis), 0, NULL);
+    XTransform xf = {{
+        {XDoubleToFixed((double)level_w / q->win_w), 0, 0},
+        {0, XDoubleToFixed((double)level_h / q->win_h), 0},
+        {0, 0, XDoubleToFixed(1)},
+    }};
+
+    XRenderSetPictureTransform(dpy, level_pic, &xf);
+    XRenderSetPictureFilter(dpy, level_pic, fast ? FilterFast : FilterGood, NULL, 0);
+    XRenderComposite(dpy, PictOpSrc, level_pic, None, dst, 0, 0, 0, 0, 0, 0, q->win_w, q->win_h);
+    XRenderFreePicture(dpy, dst);
+    return p;
+}
+
+#else
+
+void xrender_invalidate(void)
+{
+}
+
+void xrender_install_level(qiv_image *q, const DATA32 *data, int w, int h)
+{
+}
+
+int xrender_prepare(qiv_image *q)
+{
+    return 0;
+}
+
+Pixmap xrender_render(qiv_image *q, int fast)
+{
+    return None;
+}
+
+#endif
@@ -0,0 +1,165 @@
+/*
+  Module       : xshm.c
+  Purpose      : Upload rendered frames through MIT-SHM
+  More         : see qiv README
+  Policy       : GNU GPL
+  Homepage     : http://qiv.spiegl.de/
+  Original     : http://www.klografx.net/qiv/
+*/
+
+#include "qiv.h"
+#include <gdk/gdkx.h>
+
+#ifdef HAVE_XSHM
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+/* On a local display the scaled image is written straight into a
+ * shared memory segment which the server reads from, instead of being
+ * pushed through the socket.  The segment is kept and reused for every
+ * frame; it only grows when a bigger window needs it. */
+
+static XShmSegmentInfo shm_info;
+static XImage *shm_image;
+static size_t shm_size;
+static int shm_state; // 0 not checked yet, 1 usable, -1 not available
+
+/* The ARGB data can only be used as is on a 32 bit TrueColor visual
+ * with the usual masks and our byte order. */
+static int xshm_usable(GdkDrawable *d)
+{
+    Display *dpy = gdk_x11_drawable_get_xdisplay(d);
+    Visual *vis = gdk_x11_visual_get_xvisual(gdk_drawable_get_visual(d));
+    union {
+        guint32 i;
+        char c[4];
+    } order = {1};
+
+    if (shm_state)
+        return shm_state > 0;
+
+    shm_state = -1;
+    if (!XShmQueryExtension(dpy))
+        return 0;
+    if (vis->class != TrueColor || gdk_drawable_get_depth(d) != 24 || vis->red_mask != 0xff0000 ||
+        vis->green_mask != 0xff00 || vis->blue_mask != 0xff)
+        return 0;
+    if (ImageByteOrder(dpy) != (order.c[0] ? LSBFirst : MSBFirst))
+        return 0;
+
+    shm_state = 1;
+    return 1;
+}
+
+static void xshm_detach(Display *dpy)
+{
+    if (shm_image)
+    {
+        shm_image->data = NULL; // not ours to free
+        XDestroyImage(shm_image);
+        shm_image = NULL;
+    }
+    if (shm_size)
+    {
+        XShmDetach(dpy, &shm_info);
+        XSync(dpy, False);
+        shmdt(shm_info.shmaddr);
+        shm_size = 0;
+    }
+}
+
+/* Make the segment big enough for w x h pixels.  Attaching fails on a
+ * remote display, we then stop trying. */
+static int xshm_attach(Display *dpy, size_t size)
+{
+    xshm_detach(dpy);
+
+    shm_info.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (shm_info.shmid < 0)
+        return 0;
+    shm_info.shmaddr = shmat(shm_info.shmid, NULL, 0);
+    shm_info.readOnly = True;
+    if (shm_info.shmaddr == (char *)-1)
+    {
+        shmctl(shm_info.shmid, IPC_RMID, NULL);
+        return 0;
+    }
+
+    gdk_error_trap_push();
+    XShmAttach(dpy, &shm_info);
+    XSync(dpy, False);
+    /* gone as soon as both sides detached */
+    shmctl(shm_info.shmid, IPC_RMID, NULL);
+    if (gdk_error_trap_pop())
+    {
+        shmdt(shm_info.shmaddr);
+        return 0;
+    }
+    shm_size = size;
+    return 1;
+}
+
+/* Pixel buffer for a w x h frame in the shared segment, or NULL if
+ * frames have to go the usual way. */
+DATA32 *xshm_frame(GdkDrawable *d, int w, int h)
+{
+    Display *dpy = gdk_x11_drawable_get_xdisplay(d);
+    Visual *vis = gdk_x11_visual_get_xvisual(gdk_drawable_get_visual(d));
+    size_t size = (size_t)w * h * sizeof(DATA32);
+
+    if (!xshm_usable(d))
+        return NULL;
+
+    if (shm_image && shm_image->width == w && shm_image->height == h)
+        return (DATA32 *)shm_image->data;
+
+    if (size > shm_size && !xshm_attach(dpy, size))
+    {
+        shm_state = -1;
+        return NULL;
+    }
+    if (shm_image)
+    {
+        shm_image->data = NULL;
+        XDestroyImage(shm_image);
+    }
+    shm_image = XShmCreateImage(dpy, vis, 24, ZPixmap, shm_info.shmaddr, &shm_info, w, h);
+    if (!shm_image || shm_image->bits_per_pixel != 32 || shm_image->bytes_per_line != w * 4)
+    {
+        xshm_detach(dpy);
+        shm_state = -1;
+        return NULL;
+    }
+    return (DATA32 *)shm_image->data;
+}
+
+/* Copy the frame written to xshm_frame() into a new pixmap.  We wait
+ * for the server to finish reading, the segment is reused right away
+ * for the next frame. */
+Pixmap xshm_upload(GdkDrawable *d)
+{
+    Display *dpy = gdk_x11_drawable_get_xdisplay(d);
+    Pixmap p = XCreatePixmap(dpy, gdk_x11_drawable_get_xid(d), shm_image->width,
+                             shm_image->height, 24);
+    GC gc = XCreateGC(dpy, p, 0, NULL);
+
+    XShmPutImage(dpy, p, gc, shm_image, 0, 0, 0, 0, shm_image->width, shm_image->height, False);
+    XFreeGC(dpy, gc);
+    XSync(dpy, False);
+    return p;
+}
+
+#else
+
+DATA32 *xshm_frame(GdkDrawable *d, int w, int h)
+{
+    return NULL;
+}
+
+Pixmap xshm_upload(GdkDrawable *d)
+{
+    return None;
+}
+
+#endif